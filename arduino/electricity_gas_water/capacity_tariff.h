@@ -0,0 +1,158 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <Preferences.h> // ESP32 NVS
+
+#include "time_util.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Results of QuarterHourPeakTracker::update, all in W
+struct QuarterHourPeakValues
+{
+  uint32_t quarter_average_power;           // Average power of the current quarter-hour so far
+  uint32_t predicted_quarter_average_power; // Expected average at the end of the current quarter-hour, if the power stays the same
+  uint32_t month_peak_power;                // Highest average of the completed quarter-hours this month
+  bool has_finished_quarter;                // True only on the first update after a fully followed quarter-hour ended
+  uint32_t finished_quarter_average_power;  // Average of that quarter-hour, if has_finished_quarter
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Tracks the monthly peak of 15-minute average power used by the Fluvius capacity tariff.
+ * Works incrementally on the delivered energy counters, every update is O(1):
+ *   - The average of a quarter-hour is (energy now - energy at its start) / 15 minutes
+ *   - The prediction assumes the current power holds until the end of the quarter-hour
+ * The state is stored in NVS at the start of every quarter-hour (so at most 4 writes per hour),
+ * a reboot within a quarter-hour therefore loses nothing.
+ * Quarter-hours are aligned on utc, which equals local alignment for whole-hour utc offsets.
+ */
+class QuarterHourPeakTracker
+{
+public:
+  static constexpr uint32_t quarter_secs = 15 * 60;
+  // A quarter-hour only counts towards the month peak if it was followed from (almost) its start
+  static constexpr uint32_t max_quarter_start_offset_secs = 60;
+
+  void init();
+  // energy_delivered_wh: sum of the delivered energy counters (of all tariffs), power_delivered_w: current power
+  QuarterHourPeakValues update(const DsmrTimestamp &local_timestamp, const int64_t unix_time_secs, const uint32_t energy_delivered_wh, const uint32_t power_delivered_w);
+
+private:
+  // Stored in NVS as-is, bump state_version when changing this
+  struct State
+  {
+    uint32_t state_version;
+    uint32_t month_key;                 // year * 12 + month of month_peak_power
+    uint32_t month_peak_power;          // W
+    uint32_t quarter_index;             // unix time / quarter_secs, 0 = no quarter started yet
+    uint32_t quarter_month_key;         // Month the current quarter-hour belongs to (the month of its start)
+    uint32_t quarter_start_energy_wh;   // Delivered energy at the first update of the current quarter-hour
+    uint32_t quarter_start_offset_secs; // Secs between the start of the quarter-hour and its first update
+  };
+  static constexpr uint32_t state_version = 1;
+
+  bool finish_quarter(const uint32_t energy_delivered_wh, uint32_t *average_power);
+  void save_state();
+
+private:
+  bool is_initialized = false;
+  State state = {};
+  Preferences preferences;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+void QuarterHourPeakTracker::init()
+{
+  assert(!is_initialized); // Ensure this is only called once
+
+  preferences.begin("capacity_tariff", false);
+  State stored_state;
+  if (preferences.getBytes("state", &stored_state, sizeof(stored_state)) == sizeof(stored_state) &&
+      stored_state.state_version == state_version)
+  {
+    state = stored_state;
+  }
+  state.state_version = state_version;
+
+  is_initialized = true;
+}
+
+QuarterHourPeakValues QuarterHourPeakTracker::update(const DsmrTimestamp &local_timestamp, const int64_t unix_time_secs, const uint32_t energy_delivered_wh, const uint32_t power_delivered_w)
+{
+  assert(is_initialized); // Ensure init() was called
+
+  const uint32_t quarter_index = unix_time_secs / quarter_secs;
+  const uint32_t secs_into_quarter = unix_time_secs % quarter_secs;
+
+  QuarterHourPeakValues values = {};
+
+  if (quarter_index != state.quarter_index)
+  {
+    // Only a quarter-hour that ended just now can be finished, older ones were (partly) missed
+    if (state.quarter_index != 0 && quarter_index == state.quarter_index + 1)
+      values.has_finished_quarter = finish_quarter(energy_delivered_wh, &values.finished_quarter_average_power);
+
+    state.quarter_index = quarter_index;
+    state.quarter_month_key = local_timestamp.year * 12 + local_timestamp.month;
+    state.quarter_start_energy_wh = energy_delivered_wh;
+    state.quarter_start_offset_secs = secs_into_quarter;
+    if (state.quarter_month_key != state.month_key)
+    {
+      state.month_key = state.quarter_month_key;
+      state.month_peak_power = 0;
+    }
+    save_state();
+  }
+
+  // Extrapolate from the part of the quarter-hour that was followed
+  const uint32_t energy_wh = energy_delivered_wh >= state.quarter_start_energy_wh ? energy_delivered_wh - state.quarter_start_energy_wh : 0;
+  const uint32_t followed_secs = secs_into_quarter - state.quarter_start_offset_secs;
+  const uint32_t remaining_secs = quarter_secs - secs_into_quarter;
+  const uint32_t followable_secs = quarter_secs - state.quarter_start_offset_secs;
+
+  values.quarter_average_power = followed_secs == 0 ? power_delivered_w : (uint64_t)energy_wh * 3600 / followed_secs;
+  values.predicted_quarter_average_power =
+      ((uint64_t)energy_wh * 3600 + (uint64_t)power_delivered_w * remaining_secs) / followable_secs;
+  values.month_peak_power = state.month_peak_power;
+  return values;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+// Returns false if the quarter-hour wasn't followed (almost) from its start
+bool QuarterHourPeakTracker::finish_quarter(const uint32_t energy_delivered_wh, uint32_t *average_power)
+{
+  if (state.quarter_start_offset_secs > max_quarter_start_offset_secs)
+    return false;
+
+  const uint32_t energy_wh = energy_delivered_wh >= state.quarter_start_energy_wh ? energy_delivered_wh - state.quarter_start_energy_wh : 0;
+  *average_power = (uint64_t)energy_wh * 3600 / (quarter_secs - state.quarter_start_offset_secs);
+
+  if (state.quarter_month_key != state.month_key)
+  {
+    state.month_key = state.quarter_month_key;
+    state.month_peak_power = 0;
+  }
+  if (*average_power > state.month_peak_power)
+    state.month_peak_power = *average_power;
+  return true;
+}
+
+void QuarterHourPeakTracker::save_state()
+{
+  preferences.putBytes("state", &state, sizeof(state));
+}
@@ -110,9 +110,12 @@ public:
   void init();
   void set_on_message_callback(void (*on_message_callback)(FluviusDSMRData &message));
   // This reads new data in the uart stream and calls on_message_callback for every new message
+  // The message is dropped after the callback returns, the callback may move its contents out
   void process_incoming_data();
   // Triggers a one-off reading
   void trigger_read();
+  // micros() when the CRC line of the latest telegram was read, for the telegram passed to on_message_callback
+  uint32_t get_telegram_end_micros() const { return telegram_end_micros; }
   // Prints a FluviusDSMRData struct to the debug console
   void print_dsmr_values(FluviusDSMRData &data);
 
@@ -121,6 +124,7 @@ private:
   HardwareSerial dsmr_p1_hardware_serial = HardwareSerial(settings.dsmr_p1_uart_controller_index);
   P1Reader dsmr_p1_reader = P1Reader(&dsmr_p1_hardware_serial, settings.dsmr_p1_unconnected_request_output_pin);
   void (*on_message_callback)(FluviusDSMRData &message) = nullptr;
+  uint32_t telegram_end_micros = 0;
 };
 
 ///                                   ///
@@ -150,14 +154,16 @@ void FluviusDSMRWrapper::process_incoming_data()
 
   // MM: timing per Fluvius telegram: uart reading 62 ms + parsing 1 ms
 
-  dsmr_p1_reader.loop(); // Processes any new data in the uart stream, then returns
+  dsmr_p1_reader.loop(); // Processes any new data in the uart stream, then returns (right after the CRC line, if it completes a telegram)
+  if (dsmr_p1_reader.available())
+    telegram_end_micros = micros(); // Late by however long the telegram's tail waited in the uart buffer
 
   auto handle_parser_error = [](String &error)
   {
     if (settings.use_debug_serial)
       Serial.println(error);
 
-    //wifi_http_client.send_post("/", String("Parser error: ") + error);
+    //upload_client.send_data_point(String("Parser error: ") + error);
 
     // NOTE: harmless, but for some unclear reason: 1st time the parser is called, it always detects this fault on the 2nd OBIS field:
     // > 0-0:96.1.4(50217)
@@ -10,39 +10,183 @@
 //     - Add the zip to the Arduino IDE using "Sketch -> Include Library -> Add .ZIP Library..."
 //   - TFT_eSPI:
 //     - Install the "TFT_eSPI" library version "2.5.0" through the library manager (Sketch -> Include Library -> Manage Libraries...)
+//   - ArduinoJson and ArduinoMqttClient: Install them through the library manager
+//   - HomeMonitoring: Set the sketchbook location (File -> Preferences) to the "arduino" folder of this repository
 // Version history :
 //   - 1.1.0: Extended with Water meter: reed contact on pin XX (13 or 27), with internal pullup  (gives pulse every 0.5 liter)
 //   - 1.2.0: Large refactor
 //   - 1.3.0: Send measurements to home-monitoring collector over http
+//   - 1.4.0: Timestamp measurements on the device (DSMR telegram timestamps, SNTP for the rest)
+//   - 1.5.0: Compile-time selectable upload transport (http, mqtt or udp)
+//   - 1.6.0: Serve the latest telegram on the lan (/metrics and /latest.json)
+//   - 1.7.0: Track the quarter-hour peak power of the capacity tariff
+//   - 1.8.0: Sensors run by a compile-time sensor engine, data points are sent in batches
+//   - 1.9.0: Optional https upload transport with tls session resumption
+//   - 1.10.0: Intervals, batching and thresholds tunable at runtime over mqtt
+//   - 1.11.0: Graph of the net power over the last half hour on the display
+//   - 1.12.0: Meter metadata sent once as a descriptor instead of with every data point
+//   - 1.13.0: Optionally gzip the batches of data points
+//   - 1.14.0: Optional esp-now gateway, forwards the readings of battery-powered sensor nodes
+//   - 1.15.0: Electricity and gas data points carry a trace (sequence number and capture time) for latency tracing
+//   - 1.16.0: Optional binary wire format for the electricity and gas data points
+//   - 1.17.0: Batch for longer while the collector asks to slow down, resend the batch it rejected (http and https uploads)
+//   - 1.17.1: Hold the next batch until the collector took the last one, count dropped batches (http and https uploads)
 static const String sketch_name = "electricity_gas_water";
-static const String version_stamp = "1.3.0";
+static const String version_stamp = "1.17.1";
 
 ///        ///
 // Includes //
 ///        ///
 
+#include <utility>
 #include <ArduinoJson.h>
+#include <sensor_engine.h>
+#include <point_descriptor.h>
+#include <binary_schemas.h>
+#include <runtime_config.h>
+#include <espnow_gateway.h>
 
 #include "dsmr_wrapper.h"
-#include "wifi_http_client.h"
 #include "tft_display_wrapper.h"
+#include "local_metrics_server.h"
+#include "capacity_tariff.h"
+#include "time_util.h"
 #include "util.h"
 
 #include "settings.h" // Create by copying settings.h.example to settings.h and filling in the dummy values
 
+///                   ///
+// Struct declarations //
+///                   ///
+
+using UploadBatch = PointBatch<UploadTransport, upload_batch_capacity>;
+
+// Settings that can be changed at runtime over mqtt (see runtime_config below), the defaults come from settings.h
+struct TunableSettings
+{
+  uint32_t dsmr_p1_read_interval_msecs = settings.dsmr_p1_read_interval_msecs;
+  uint32_t battery_current_read_interval_msecs = settings.battery_current_read_interval_msecs;
+  uint32_t display_refresh_interval_msecs = settings.display_refresh_interval_msecs;
+  uint32_t heartbeat_interval_msecs = settings.heartbeat_interval_msecs;
+  uint32_t upload_batch_max_delay_msecs = settings.upload_batch_max_delay_msecs;
+  uint32_t upload_batch_max_size = UploadBatch::buffer_size;
+  uint32_t capacity_tariff_peak_warning_threshold_w = settings.capacity_tariff_peak_warning_threshold_w;
+};
+
+// Reads DSMR P1 telegrams, encodes the electricity, capacity tariff and gas measurements of every new telegram
+struct DsmrSensor
+{
+  static constexpr const char *name = "dsmr";
+  uint32_t interval_msecs() const { return 0; } // Incoming data is processed on every run, reads are triggered every dsmr_p1_read_interval_msecs
+  bool sample();
+  void encode(UploadBatch &batch);
+
+  void on_message(FluviusDSMRData &message); // Called from on_dsmr_message_callback, takes over its contents
+
+private:
+  void track_capacity_tariff();
+  void encode_electricity(UploadBatch &batch);
+  void encode_capacity_tariff(UploadBatch &batch);
+  void encode_gas(UploadBatch &batch);
+  void encode_electricity_binary(UploadBatch &batch, uint32_t descriptor_id);
+  void encode_gas_binary(UploadBatch &batch, uint32_t descriptor_id);
+  uint32_t register_electricity_descriptor(UploadBatch &batch);
+  uint32_t register_gas_descriptor(UploadBatch &batch);
+  void add_trace(JsonObject trace, char *capture_time_buffer);
+  uint64_t get_capture_unix_time_nsecs();
+
+private:
+  uint32_t trigger_read_state = 0;
+  FluviusDSMRData message;
+  bool has_new_message = false;
+  uint32_t telegram_count = 0;
+  uint32_t telegram_end_micros = 0;
+  bool has_peak_values = false;
+  int64_t peak_unix_time_secs = 0;
+  QuarterHourPeakValues peak_values = {};
+  PointDescriptor electricity_descriptor{settings.descriptor_refresh_interval_msecs};
+  PointDescriptor gas_descriptor{settings.descriptor_refresh_interval_msecs};
+};
+
+// Only updates battery_current, for the display
+struct BatteryCurrentSensor
+{
+  static constexpr const char *name = "battery_current";
+  uint32_t interval_msecs() const;
+  bool sample();
+  void encode(UploadBatch &/* batch */) {}
+};
+
+// Not a sensor as such, but it has a cadence and its cpu time is worth knowing too
+struct DisplaySensor
+{
+  static constexpr const char *name = "display";
+  uint32_t interval_msecs() const;
+  bool sample();
+  void encode(UploadBatch &/* batch */) {}
+};
+
+// Forwards the readings the esp-now gateway received from sensor nodes (see the espnow_node_example sketch)
+struct EspNowGatewaySensor
+{
+  static constexpr const char *name = "espnow_gateway";
+  uint32_t interval_msecs() const { return 0; } // Readings are queued by the wifi task, forwarded on every run
+  bool sample();
+  void encode(UploadBatch &batch);
+
+private:
+  void encode_reading(const NodeReading &reading, bool is_time_known, uint64_t unix_time_nsecs, uint32_t now_msecs, UploadBatch &batch);
+};
+
+// Encodes a heartbeat with the cpu time of every sensor since the previous heartbeat
+struct HeartbeatSensor
+{
+  static constexpr const char *name = "heartbeat";
+  uint32_t interval_msecs() const;
+  bool sample() { return true; }
+  void encode(UploadBatch &batch);
+};
+
 ///       ///
 // Globals //
 ///       ///
 
+const RuntimeSettingDescriptor<TunableSettings> tunable_setting_descriptors[] = {
+    // name, member, min, max
+    {"dsmr_p1_read_interval_msecs", &TunableSettings::dsmr_p1_read_interval_msecs, 100, 60000},
+    {"battery_current_read_interval_msecs", &TunableSettings::battery_current_read_interval_msecs, 100, 600000},
+    {"display_refresh_interval_msecs", &TunableSettings::display_refresh_interval_msecs, 100, 60000},
+    {"heartbeat_interval_msecs", &TunableSettings::heartbeat_interval_msecs, 1000, 3600000},
+    {"upload_batch_max_delay_msecs", &TunableSettings::upload_batch_max_delay_msecs, 0, 600000},
+    {"upload_batch_max_size", &TunableSettings::upload_batch_max_size, 256, UploadBatch::buffer_size},
+    {"capacity_tariff_peak_warning_threshold_w", &TunableSettings::capacity_tariff_peak_warning_threshold_w, 0, 100000},
+};
+RuntimeConfig runtime_config(tunable_setting_descriptors, "runtime_config");
+WifiMqttClient config_client(
+    settings.wifi_ssid, settings.wifi_pass,
+    settings.config_mqtt_broker_address, settings.config_mqtt_broker_port,
+    settings.use_debug_serial,
+    512); // Incoming message size limit, a config with every setting is under 400 bytes
+const String config_topic = String("config/") + settings.device_identifier; // Retained, set by the user
+const String active_config_topic = String("config-active/") + settings.device_identifier; // Retained, set by this device
+
 FluviusDSMRWrapper dsmr_wrapper;
-WifiHttpClient wifi_http_client(
+UploadTransport upload_client( // Picked in settings.h
     settings.wifi_ssid, settings.wifi_pass,
-    settings.http_server_address, settings.http_server_port,
+    settings.collector_address, settings.collector_port,
     settings.use_debug_serial);
 TftDisplayWrapper display_wrapper;
-
-uint32_t power_consumption = 0; // in Wh
+PowerHistory<TftDisplayWrapper::power_graph_width> power_history(settings.power_history_window_msecs);
+LocalMetricsServer local_metrics_server(settings.local_metrics_server_port, settings.local_metrics_server_max_clients);
+QuarterHourPeakTracker quarter_hour_peak_tracker;
+EspNowGateway<256, 64> espnow_gateway; // Up to 256 sensor nodes, up to 64 readings queued between two runs of the sensor engine
+SensorEngine<UploadTransport, upload_batch_capacity, DsmrSensor, BatteryCurrentSensor, DisplaySensor, EspNowGatewaySensor, HeartbeatSensor>
+    sensor_engine(upload_client, settings.upload_batch_max_delay_msecs);
+UploadBatch::Compressor upload_compressor; // Only used if settings.use_upload_gzip
+
+int32_t power_consumption = 0; // in W, negative while injecting
 float battery_current = 0; // -100 to 100
+uint32_t predicted_quarter_average_power = 0; // in W
 
 ///                     ///
 // Function declarations //
@@ -51,8 +195,19 @@ float battery_current = 0; // -100 to 100
 void setup();
 void loop();
 void on_dsmr_message_callback(FluviusDSMRData &message);
-void read_battery_current();
-void send_heartbeat();
+void on_config_message(String &topic, String &message);
+void apply_runtime_config();
+void publish_active_config(const char *error);
+template <typename Transport>
+void configure_upload_transport(Transport &transport);
+void configure_upload_transport(WifiHttpsClient &transport);
+template <typename Transport>
+void add_upload_transport_stats(JsonObject fields, Transport &transport);
+void add_upload_transport_stats(JsonObject fields, WifiHttpClient &transport);
+void add_upload_transport_stats(JsonObject fields, WifiHttpsClient &transport);
+void add_http_response_stats(JsonObject fields, const HttpResponseStats &stats);
+bool dsmr_timestamp_to_unix_nsecs(const String &dsmr_timestamp, uint64_t *unix_time_nsecs);
+bool dsmr_timestamp_to_time_string(const String &dsmr_timestamp, char *time_buffer);
 
 ///                    ///
 // Function definitions //
@@ -74,10 +229,27 @@ void setup()
   if (settings.use_debug_serial)
     print_sketch_version(version_stamp, String(__FILE__));
 
+  runtime_config.init(); // Values stored in NVS, until the retained config arrives
+  apply_runtime_config();
+
   dsmr_wrapper.init();
+  quarter_hour_peak_tracker.init();
   dsmr_wrapper.set_on_message_callback(on_dsmr_message_callback);
 
-  wifi_http_client.first_connect();
+  configure_upload_transport(upload_client);
+  if (settings.use_upload_gzip)
+    sensor_engine.get_batch().set_compressor(&upload_compressor);
+  if (settings.use_upload_binary)
+    sensor_engine.get_batch().set_wire_format(WireFormat::binary);
+  upload_client.first_connect();
+  if (settings.use_espnow_gateway && !espnow_gateway.begin() && settings.use_debug_serial) // On the channel of the access point
+    Serial.println("Could not start the esp-now gateway");
+  config_client.set_on_message(on_config_message);
+  config_client.subscribe(config_topic);
+  config_client.first_connect();
+  publish_active_config(nullptr);
+  start_sntp_sync(settings.ntp_server_address);
+  local_metrics_server.init();
 
   display_wrapper.init();
 
@@ -92,160 +264,580 @@ void setup()
 
 void loop()
 {
-  wifi_http_client.reconnect_if_needed(); // blocks but fails fast
+  upload_client.reconnect_if_needed(); // blocks but fails fast
+  config_client.reconnect_if_needed();
+  config_client.process_incoming_messages(); // calls on_config_message when the config changes (and after every reconnect)
+  sensor_engine.run(); // runs the sensors that are due, sends their data points in batches
+}
+
+void on_dsmr_message_callback(FluviusDSMRData &message)
+{
+  sensor_engine.get<DsmrSensor>().on_message(message);
+}
+
+void on_config_message(String &topic, String &message)
+{
+  if (topic != config_topic)
+    return;
+
+  const char *error = nullptr;
+  if (runtime_config.apply_json(message.c_str(), message.length(), &error))
+    apply_runtime_config();
+  else if (settings.use_debug_serial)
+    Serial.println(String("Rejected runtime config: ") + error);
+
+  publish_active_config(error);
+}
+
+// Hands the runtime config to the objects that keep their own copy, everything else reads runtime_config directly
+void apply_runtime_config()
+{
+  const TunableSettings &tunable_settings = runtime_config.get();
+  sensor_engine.get_batch().set_max_delay_msecs(tunable_settings.upload_batch_max_delay_msecs);
+  sensor_engine.get_batch().set_max_size(tunable_settings.upload_batch_max_size);
+}
+
+// Echoes the active config (and why the last one was rejected, if it was) on the retained active config topic
+void publish_active_config(const char *error)
+{
+  String json_string;
+  runtime_config.serialize_active(json_string, error);
+  config_client.publish(active_config_topic, json_string, true);
+}
+
+///                             ///
+// Sensor method implementations //
+///                             ///
+
+void DsmrSensor::on_message(FluviusDSMRData &message)
+{
+  // Telegrams arrive at most once per read, only the latest one is kept
+  // The wrapper drops its message right after this call: moving takes over its String buffers instead of copying them
+  this->message = std::move(message);
+  telegram_end_micros = dsmr_wrapper.get_telegram_end_micros();
+  has_new_message = true;
+}
+
+bool DsmrSensor::sample()
+{
   dsmr_wrapper.process_incoming_data(); // calls on_dsmr_message_callback for each new telegram
 
   // Call dsmr_wrapper.trigger_read() every dsmr_p1_read_interval_msecs
-  {
-    static uint32_t rii_dsmr_wrapper_trigger_read_state = 0;
-    run_in_interval_nonblocking(&rii_dsmr_wrapper_trigger_read_state, settings.dsmr_p1_read_interval_msecs, []()
-                                { dsmr_wrapper.trigger_read(); });
-  }
+  run_in_interval_nonblocking(&trigger_read_state, runtime_config.get().dsmr_p1_read_interval_msecs, []()
+                              { dsmr_wrapper.trigger_read(); });
 
-  // Call read_battery_current() every battery_current_read_interval_msecs
-  {
-    static uint32_t rii_read_battery_current_state = 0;
-    run_in_interval_nonblocking(&rii_read_battery_current_state, settings.battery_current_read_interval_msecs, []()
-                                { read_battery_current(); });
-  }
+  if (!has_new_message)
+    return false;
+  has_new_message = false;
+
+  if (settings.use_debug_serial)
+    dsmr_wrapper.print_dsmr_values(message);
+
+  // Store power consumption in W (original is Wh) for Display
+  power_consumption = (message.power_delivered - message.power_returned) * 1000;
+  power_history.add(power_consumption, millis());
 
-  // Call display_wrapper.draw_metrics() every second
+  // Hand the latest values to the local metrics server (lock-free, never waits for its clients)
   {
-    static uint32_t rii_display_wrapper_draw_metrics_state = 0;
-    run_in_interval_nonblocking(&rii_display_wrapper_draw_metrics_state, 1000, []()
-                                { display_wrapper.draw_metrics(power_consumption, battery_current, 0, String(settings.wifi_ssid)); });
+    uint64_t unix_time_nsecs;
+    if (!dsmr_timestamp_to_unix_nsecs(message.timestamp, &unix_time_nsecs))
+      unix_time_nsecs = 0;
+    local_metrics_server.publish(make_dsmr_snapshot(message, ++telegram_count, unix_time_nsecs));
   }
 
-  // Call send_heartbeat() every 30 seconds
+  track_capacity_tariff();
+  return true;
+}
+
+void DsmrSensor::encode(UploadBatch &batch)
+{
+  encode_electricity(batch);
+  // Sent with every telegram, so the prediction is usable while the quarter-hour is still running
+  if (has_peak_values)
+    encode_capacity_tariff(batch);
+  encode_gas(batch);
+}
+
+// Updates the quarter-hour peak, and the prediction shown on the display
+void DsmrSensor::track_capacity_tariff()
+{
+  has_peak_values = false;
+
+  // Quarter-hours are based on the meter's own clock
+  DsmrTimestamp local_timestamp;
+  if (message.timestamp.length() < 13 || !parse_dsmr_timestamp(message.timestamp.c_str(), &local_timestamp))
+    return;
+  peak_unix_time_secs = dsmr_timestamp_to_unix_secs(
+      local_timestamp, settings.dsmr_utc_offset_winter_secs, settings.dsmr_utc_offset_summer_secs);
+
+  // FixedValue milli-units: kWh -> Wh and kW -> W
+  const uint32_t energy_delivered_wh = message.energy_delivered_tariff1.int_val() + message.energy_delivered_tariff2.int_val();
+  const uint32_t power_delivered_w = message.power_delivered.int_val();
+
+  peak_values = quarter_hour_peak_tracker.update(local_timestamp, peak_unix_time_secs, energy_delivered_wh, power_delivered_w);
+  predicted_quarter_average_power = peak_values.predicted_quarter_average_power;
+  has_peak_values = true;
+}
+
+void DsmrSensor::encode_electricity(UploadBatch &batch)
+{
+  char time_buffer[21]; // Must outlive json, which only stores a pointer to it
+  char capture_time_buffer[21]; // Must outlive json, which only stores a pointer to it
+  FixedValueJsonFormatter<19 * milli_value_max_length> fixed_values; // Must outlive json, which only stores pointers into it
+
+  // Metadata (tags, message_long), registered with the collector and only referenced from here on
+  const uint32_t descriptor_id = register_electricity_descriptor(batch);
+  if (batch.get_wire_format() == WireFormat::binary)
   {
-    static uint32_t rii_heartbeat_read_state = 0;
-    run_in_interval_nonblocking(&rii_heartbeat_read_state, 30000, []()
-                                { send_heartbeat(); });
+    encode_electricity_binary(batch, descriptor_id);
+    return;
   }
+
+  // Create json object to send
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  // Example json: See project readme file
+  StaticJsonDocument<768> json; // Gets destroyed when leaving this scope
+
+  // Influxdb-specific
+  json["bucket"] = "fluvius_smart_meter";
+  json["measurement"] = "fluvius_smart_meter_electricity";
+  if (dsmr_timestamp_to_time_string(message.timestamp, time_buffer))
+    json["time"] = (const char *)time_buffer;
+  json["descriptor"] = descriptor_id;
+  if (settings.use_point_traces)
+    add_trace(json.createNestedObject("trace"), capture_time_buffer);
+
+  // Metadata (electricity-specific)
+  json["fields"]["electricity_switch_position"] = message.electricity_switch_position;          // uint8_t
+  json["fields"]["electricity_threshold"] = fixed_values.format(message.electricity_threshold); // FixedValue
+  json["fields"]["current_max"] = message.current_max;                                          // uint16_t (MM 23-5-2023: added)
+  json["fields"]["electricity_tariff"] = message.electricity_tariff;                            // String
+
+  // Electricity aggregates
+  json["fields"]["energy_delivered_tariff1"] = fixed_values.format(message.energy_delivered_tariff1); // FixedValue
+  json["fields"]["energy_delivered_tariff2"] = fixed_values.format(message.energy_delivered_tariff2); // FixedValue
+  json["fields"]["energy_returned_tariff1"] = fixed_values.format(message.energy_returned_tariff1);   // FixedValue
+  json["fields"]["energy_returned_tariff2"] = fixed_values.format(message.energy_returned_tariff2);   // FixedValue
+
+  // Electricity live values
+  json["fields"]["power_delivered"] = fixed_values.format(message.power_delivered);       // FixedValue
+  json["fields"]["power_delivered_l1"] = fixed_values.format(message.power_delivered_l1); // FixedValue
+  json["fields"]["power_delivered_l2"] = fixed_values.format(message.power_delivered_l2); // FixedValue
+  json["fields"]["power_delivered_l3"] = fixed_values.format(message.power_delivered_l3); // FixedValue
+  json["fields"]["power_returned"] = fixed_values.format(message.power_returned);         // FixedValue
+  json["fields"]["power_returned_l1"] = fixed_values.format(message.power_returned_l1);   // FixedValue
+  json["fields"]["power_returned_l2"] = fixed_values.format(message.power_returned_l2);   // FixedValue
+  json["fields"]["power_returned_l3"] = fixed_values.format(message.power_returned_l3);   // FixedValue
+  json["fields"]["voltage_l1"] = fixed_values.format(message.voltage_l1);                 // FixedValue
+  json["fields"]["voltage_l2"] = fixed_values.format(message.voltage_l2);                 // FixedValue
+  json["fields"]["voltage_l3"] = fixed_values.format(message.voltage_l3);                 // FixedValue
+  json["fields"]["current_l1"] = fixed_values.format(message.current_l1_redef);           // FixedValue
+  json["fields"]["current_l2"] = fixed_values.format(message.current_l2_redef);           // FixedValue
+  json["fields"]["current_l3"] = fixed_values.format(message.current_l3_redef);           // FixedValue
+
+  batch.add(json);
 }
 
-void on_dsmr_message_callback(FluviusDSMRData &message)
+void DsmrSensor::encode_capacity_tariff(UploadBatch &batch)
 {
-  if (settings.use_debug_serial)
-    dsmr_wrapper.print_dsmr_values(message);
+  char time_buffer[21]; // Must outlive json, which only stores a pointer to it
+  char power_buffers[4][milli_value_max_length]; // Must outlive json, which only stores pointers into it
 
-  // Store power consumption in W (original is Wh) for Display
-  power_consumption = (message.power_delivered - message.power_returned) * 1000;
+  // Create json object to send
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  StaticJsonDocument<256> json; // Gets destroyed when leaving this scope
+
+  json["bucket"] = "fluvius_smart_meter";
+  json["measurement"] = "fluvius_capacity_tariff";
+  u64_to_decimal((uint64_t)peak_unix_time_secs * 1000000000ULL, time_buffer);
+  json["time"] = (const char *)time_buffer;
 
-  // Send electricity measurement
+  json["tags"]["identification"] = message.identification; // String
+
+  // W are milli-units of kW, the unit of the power fields
+  json["fields"]["quarter_average_power"] = serialized((const char *)power_buffers[0], format_milli_value(peak_values.quarter_average_power, power_buffers[0]));
+  json["fields"]["predicted_quarter_average_power"] = serialized((const char *)power_buffers[1], format_milli_value(peak_values.predicted_quarter_average_power, power_buffers[1]));
+  json["fields"]["month_peak_power"] = serialized((const char *)power_buffers[2], format_milli_value(peak_values.month_peak_power, power_buffers[2]));
+  if (peak_values.has_finished_quarter)
+    json["fields"]["finished_quarter_average_power"] = serialized((const char *)power_buffers[3], format_milli_value(peak_values.finished_quarter_average_power, power_buffers[3]));
+
+  batch.add(json);
+}
+
+void DsmrSensor::encode_gas(UploadBatch &batch)
+{
+  char time_buffer[21]; // Must outlive json, which only stores a pointer to it
+  char capture_time_buffer[21]; // Must outlive json, which only stores a pointer to it
+  FixedValueJsonFormatter<1 * milli_value_max_length> fixed_values; // Must outlive json, which only stores pointers into it
+
+  // Metadata (tags, message_long), registered with the collector and only referenced from here on
+  const uint32_t descriptor_id = register_gas_descriptor(batch);
+  if (batch.get_wire_format() == WireFormat::binary)
   {
-    // Construct a json string to send over HTTP
-    String json_string;
-    {
-      // Create json object to send
-      // Use https://arduinojson.org/v6/assistant to get the recommended static document size
-      // Example json: See project readme file
-      StaticJsonDocument<768> json; // Gets destroyed when leaving this scope
-
-      // Influxdb-specific
-      json["bucket"] = "fluvius_smart_meter";
-      json["measurement"] = "fluvius_smart_meter_electricity";
-
-      // Metadata (general)
-      json["tags"]["identification"] = message.identification; // String
-      json["tags"]["equipment_id"] = message.equipment_id;     // String
-      json["fields"]["message_long"] = message.message_long;   // String
-
-      // Metadata (electricity-specific)
-      json["tags"]["meter_id_electr"] = message.meter_id_electr;                                          // String (MM 23-5-2023: added)
-      json["fields"]["electricity_switch_position"] = message.electricity_switch_position;                // uint8_t
-      json["fields"]["electricity_threshold"] = fixed_value_to_json_float(message.electricity_threshold); // FixedValue
-      json["fields"]["current_max"] = message.current_max;                                                // uint16_t (MM 23-5-2023: added)
-      json["fields"]["electricity_tariff"] = message.electricity_tariff;                                  // String
-
-      // Electricity aggregates
-      json["fields"]["energy_delivered_tariff1"] = fixed_value_to_json_float(message.energy_delivered_tariff1); // FixedValue
-      json["fields"]["energy_delivered_tariff2"] = fixed_value_to_json_float(message.energy_delivered_tariff2); // FixedValue
-      json["fields"]["energy_returned_tariff1"] = fixed_value_to_json_float(message.energy_returned_tariff1);   // FixedValue
-      json["fields"]["energy_returned_tariff2"] = fixed_value_to_json_float(message.energy_returned_tariff2);   // FixedValue
-
-      // Electricity live values
-      json["fields"]["power_delivered"] = fixed_value_to_json_float(message.power_delivered);       // FixedValue
-      json["fields"]["power_delivered_l1"] = fixed_value_to_json_float(message.power_delivered_l1); // FixedValue
-      json["fields"]["power_delivered_l2"] = fixed_value_to_json_float(message.power_delivered_l2); // FixedValue
-      json["fields"]["power_delivered_l3"] = fixed_value_to_json_float(message.power_delivered_l3); // FixedValue
-      json["fields"]["power_returned"] = fixed_value_to_json_float(message.power_returned);         // FixedValue
-      json["fields"]["power_returned_l1"] = fixed_value_to_json_float(message.power_returned_l1);   // FixedValue
-      json["fields"]["power_returned_l2"] = fixed_value_to_json_float(message.power_returned_l2);   // FixedValue
-      json["fields"]["power_returned_l3"] = fixed_value_to_json_float(message.power_returned_l3);   // FixedValue
-      json["fields"]["voltage_l1"] = fixed_value_to_json_float(message.voltage_l1);                 // FixedValue
-      json["fields"]["voltage_l2"] = fixed_value_to_json_float(message.voltage_l2);                 // FixedValue
-      json["fields"]["voltage_l3"] = fixed_value_to_json_float(message.voltage_l3);                 // FixedValue
-      json["fields"]["current_l1"] = fixed_value_to_json_float(message.current_l1_redef);           // FixedValue
-      json["fields"]["current_l2"] = fixed_value_to_json_float(message.current_l2_redef);           // FixedValue
-      json["fields"]["current_l3"] = fixed_value_to_json_float(message.current_l3_redef);           // FixedValue
-
-      serializeJson(json, json_string);
-    }
-    wifi_http_client.send_post("/", json_string);
+    encode_gas_binary(batch, descriptor_id);
+    return;
   }
 
-  // Send gas measurement
+  // Create json object to send
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  // Example json: See project readme file
+  StaticJsonDocument<384> json; // Gets destroyed when leaving this scope
+
+  // Influxdb-specific
+  json["bucket"] = "fluvius_smart_meter";
+  json["measurement"] = "fluvius_smart_meter_gas";
+  if (dsmr_timestamp_to_time_string(message.gas_m3.timestamp, time_buffer)) // The gas meter reports its own (less frequent) timestamp
+    json["time"] = (const char *)time_buffer;
+  json["descriptor"] = descriptor_id;
+  if (settings.use_point_traces)
+    add_trace(json.createNestedObject("trace"), capture_time_buffer);
+
+  // Metadata (gas-specific)
+  json["fields"]["gas_device_type"] = String(message.gas_device_type); // uint16_t
+  json["fields"]["gas_valve_position"] = message.gas_valve_position;   // uint8_t
+
+  // Gas live values
+  json["fields"]["gas_m3"] = fixed_values.format(message.gas_m3); // TimestampedFixedValue (MM 23-5-2023: added)
+
+  batch.add(json);
+}
+
+// Same data point as encode_electricity, as a binary point record: raw milli-units by field id, nothing formatted
+void DsmrSensor::encode_electricity_binary(UploadBatch &batch, uint32_t descriptor_id)
+{
+  using Field = FluviusElectricityField;
+  BinaryPoint<Field> point((uint8_t)BinarySchema::fluvius_electricity);
+
+  uint64_t unix_time_nsecs;
+  if (dsmr_timestamp_to_unix_nsecs(message.timestamp, &unix_time_nsecs))
+    point.set_time(unix_time_nsecs);
+  point.set_descriptor(descriptor_id);
+  if (settings.use_point_traces)
+    point.set_trace(settings.device_identifier.c_str(), telegram_count, get_capture_unix_time_nsecs());
+
+  // Metadata (electricity-specific)
+  point.set(Field::electricity_switch_position, message.electricity_switch_position);
+  point.set(Field::electricity_threshold, message.electricity_threshold.int_val());
+  point.set(Field::current_max, message.current_max);
+  point.set(Field::electricity_tariff, message.electricity_tariff.toInt()); // "0001", the collector pads it again
+
+  // Electricity aggregates
+  point.set(Field::energy_delivered_tariff1, message.energy_delivered_tariff1.int_val());
+  point.set(Field::energy_delivered_tariff2, message.energy_delivered_tariff2.int_val());
+  point.set(Field::energy_returned_tariff1, message.energy_returned_tariff1.int_val());
+  point.set(Field::energy_returned_tariff2, message.energy_returned_tariff2.int_val());
+
+  // Electricity live values
+  point.set(Field::power_delivered, message.power_delivered.int_val());
+  point.set(Field::power_delivered_l1, message.power_delivered_l1.int_val());
+  point.set(Field::power_delivered_l2, message.power_delivered_l2.int_val());
+  point.set(Field::power_delivered_l3, message.power_delivered_l3.int_val());
+  point.set(Field::power_returned, message.power_returned.int_val());
+  point.set(Field::power_returned_l1, message.power_returned_l1.int_val());
+  point.set(Field::power_returned_l2, message.power_returned_l2.int_val());
+  point.set(Field::power_returned_l3, message.power_returned_l3.int_val());
+  point.set(Field::voltage_l1, message.voltage_l1.int_val());
+  point.set(Field::voltage_l2, message.voltage_l2.int_val());
+  point.set(Field::voltage_l3, message.voltage_l3.int_val());
+  point.set(Field::current_l1, message.current_l1_redef.int_val());
+  point.set(Field::current_l2, message.current_l2_redef.int_val());
+  point.set(Field::current_l3, message.current_l3_redef.int_val());
+
+  batch.add_binary(point);
+}
+
+// Same data point as encode_gas, as a binary point record
+void DsmrSensor::encode_gas_binary(UploadBatch &batch, uint32_t descriptor_id)
+{
+  using Field = FluviusGasField;
+  BinaryPoint<Field> point((uint8_t)BinarySchema::fluvius_gas);
+
+  uint64_t unix_time_nsecs;
+  if (dsmr_timestamp_to_unix_nsecs(message.gas_m3.timestamp, &unix_time_nsecs)) // The gas meter reports its own (less frequent) timestamp
+    point.set_time(unix_time_nsecs);
+  point.set_descriptor(descriptor_id);
+  if (settings.use_point_traces)
+    point.set_trace(settings.device_identifier.c_str(), telegram_count, get_capture_unix_time_nsecs());
+
+  point.set(Field::gas_device_type, message.gas_device_type);
+  point.set(Field::gas_valve_position, message.gas_valve_position);
+  point.set(Field::gas_m3, message.gas_m3.int_val());
+
+  batch.add_binary(point);
+}
+
+uint32_t DsmrSensor::register_electricity_descriptor(UploadBatch &batch)
+{
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  StaticJsonDocument<512> json; // Gets destroyed when leaving this scope
+
+  // Metadata (general)
+  json["tags"]["identification"] = message.identification; // String
+  json["tags"]["equipment_id"] = message.equipment_id;     // String
+  json["fields"]["message_long"] = message.message_long;   // String
+
+  // Metadata (electricity-specific)
+  json["tags"]["meter_id_electr"] = message.meter_id_electr; // String (MM 23-5-2023: added)
+
+  return electricity_descriptor.register_if_needed(json, batch, upload_client.get_server_connect_count());
+}
+
+uint32_t DsmrSensor::register_gas_descriptor(UploadBatch &batch)
+{
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  StaticJsonDocument<512> json; // Gets destroyed when leaving this scope
+
+  // Metadata (general)
+  json["tags"]["identification"] = message.identification; // String
+  json["tags"]["equipment_id"] = message.equipment_id;     // String
+  json["fields"]["message_long"] = message.message_long;   // String
+
+  // Metadata (gas-specific)
+  json["tags"]["meter_id_gas"] = message.meter_id_gas; // String (MM 23-5-2023: added)
+
+  return gas_descriptor.register_if_needed(json, batch, upload_client.get_server_connect_count());
+}
+
+// Lets the collector measure how stale the data point is when it's written, and count the ones that never arrived
+// Every telegram gets the next sequence number, the capture time is when its CRC line was read
+void DsmrSensor::add_trace(JsonObject trace, char *capture_time_buffer)
+{
+  trace["source"] = settings.device_identifier;
+  trace["sequence"] = telegram_count;
+
+  const uint64_t capture_unix_time_nsecs = get_capture_unix_time_nsecs();
+  if (capture_unix_time_nsecs != 0)
   {
-    // Construct a json string to send over HTTP
-    String json_string;
-    {
-      // Create json object to send
-      // Use https://arduinojson.org/v6/assistant to get the recommended static document size
-      // Example json: See project readme file
-      StaticJsonDocument<384> json; // Gets destroyed when leaving this scope
-
-      // Influxdb-specific
-      json["bucket"] = "fluvius_smart_meter";
-      json["measurement"] = "fluvius_smart_meter_gas";
-
-      // Metadata (general)
-      json["tags"]["identification"] = message.identification; // String
-      json["tags"]["equipment_id"] = message.equipment_id;     // String
-      json["fields"]["message_long"] = message.message_long;   // String
-      
-      // Metadata (gas-specific)
-      json["tags"]["meter_id_gas"] = message.meter_id_gas;                 // String (MM 23-5-2023: added)
-      json["fields"]["gas_device_type"] = String(message.gas_device_type); // uint16_t
-      json["fields"]["gas_valve_position"] = message.gas_valve_position;   // uint8_t
-
-      // Gas live values
-      json["fields"]["gas_m3"] = fixed_value_to_json_float(message.gas_m3); // TimestampedFixedValue (MM 23-5-2023: added)
-
-      serializeJson(json, json_string);
-    }
-    wifi_http_client.send_post("/", json_string);
+    u64_to_decimal(capture_unix_time_nsecs, capture_time_buffer);
+    trace["capture_time"] = (const char *)capture_time_buffer;
   }
 }
 
-void read_battery_current()
+// Returns 0 if the time is unknown
+uint64_t DsmrSensor::get_capture_unix_time_nsecs()
+{
+  uint64_t unix_time_nsecs;
+  if (!get_unix_time_nsecs(&unix_time_nsecs))
+    return 0;
+  return unix_time_nsecs - (uint64_t)(micros() - telegram_end_micros) * 1000ULL;
+}
+
+uint32_t BatteryCurrentSensor::interval_msecs() const
+{
+  return runtime_config.get().battery_current_read_interval_msecs;
+}
+
+bool BatteryCurrentSensor::sample()
 {
   uint16_t voltage_10bit = analogRead(settings.battery_current_read_pin);
   float voltage_normalized = voltage_10bit / 1023.0;
   float voltage_centered_on_zero = (voltage_normalized * 2) - 1;
   battery_current = voltage_centered_on_zero * 100;
+  return false;
 }
 
-void send_heartbeat()
+uint32_t DisplaySensor::interval_msecs() const
+{
+  return runtime_config.get().display_refresh_interval_msecs;
+}
+
+bool DisplaySensor::sample()
+{
+  const bool show_peak_warning = predicted_quarter_average_power > runtime_config.get().capacity_tariff_peak_warning_threshold_w;
+  display_wrapper.draw_metrics(power_consumption, battery_current, 0, String(settings.wifi_ssid),
+                               show_peak_warning, predicted_quarter_average_power);
+  display_wrapper.draw_power_history(power_history);
+  return false;
+}
+
+bool EspNowGatewaySensor::sample()
+{
+  return espnow_gateway.has_queued_readings();
+}
+
+void EspNowGatewaySensor::encode(UploadBatch &batch)
+{
+  // Readings carry the millis() of their arrival, converted to unix time here
+  uint64_t unix_time_nsecs;
+  const bool is_time_known = get_unix_time_nsecs(&unix_time_nsecs);
+  const uint32_t now_msecs = millis();
+
+  espnow_gateway.process([&](const NodeReading &reading)
+                         { encode_reading(reading, is_time_known, unix_time_nsecs, now_msecs, batch); });
+}
+
+void EspNowGatewaySensor::encode_reading(const NodeReading &reading, bool is_time_known, uint64_t unix_time_nsecs, uint32_t now_msecs, UploadBatch &batch)
+{
+  constexpr size_t measurement_count = sizeof(espnow_node_measurements) / sizeof(espnow_node_measurements[0]);
+  if (reading.packet.measurement >= measurement_count)
+  {
+    if (settings.use_debug_serial)
+      Serial.println("Dropping an esp-now reading of an unknown measurement");
+    return;
+  }
+  const NodeMeasurement &node_measurement = espnow_node_measurements[reading.packet.measurement];
+
+  char time_buffer[21]; // Must outlive json, which only stores a pointer to it
+  char node_buffer[13]; // Must outlive json, which only stores a pointer to it
+  char value_buffers[max_node_reading_values][milli_value_max_length]; // Must outlive json, which only stores pointers into it
+
+  // Create json object to send
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  StaticJsonDocument<256> json; // Gets destroyed when leaving this scope
+
+  json["bucket"] = node_measurement.bucket;
+  json["measurement"] = node_measurement.measurement;
+  if (is_time_known)
+  {
+    u64_to_decimal(unix_time_nsecs - (uint64_t)(now_msecs - reading.receive_timestamp_msecs) * 1000000ULL, time_buffer);
+    json["time"] = (const char *)time_buffer;
+  }
+  snprintf(node_buffer, sizeof(node_buffer), "%02x%02x%02x%02x%02x%02x",
+           reading.mac[0], reading.mac[1], reading.mac[2], reading.mac[3], reading.mac[4], reading.mac[5]);
+  json["tags"]["node"] = (const char *)node_buffer;
+
+  for (uint8_t i = 0; i < reading.packet.value_count; i++)
+  {
+    const char *field_name = node_measurement.field_names[i];
+    if (field_name != nullptr)
+      json["fields"][field_name] = serialized((const char *)value_buffers[i], format_milli_value(reading.packet.milli_values[i], value_buffers[i]));
+  }
+
+  batch.add(json);
+}
+
+uint32_t HeartbeatSensor::interval_msecs() const
+{
+  return runtime_config.get().heartbeat_interval_msecs;
+}
+
+void HeartbeatSensor::encode(UploadBatch &batch)
 {
   if (settings.use_debug_serial)
     Serial.println("Sending heartbeat");
 
-  // Construct a json string to send over HTTP
-  String json_string;
+  char time_buffer[21]; // Must outlive json, which only stores a pointer to it
+
+  // Create json object to send
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  // The stats field names are copied into the document
+  StaticJsonDocument<1536> json; // Gets destroyed when leaving this scope
+
+  json["bucket"] = "heartbeat";
+  json["measurement"] = "heartbeat";
+  uint64_t unix_time_nsecs;
+  if (get_unix_time_nsecs(&unix_time_nsecs))
+  {
+    u64_to_decimal(unix_time_nsecs, time_buffer);
+    json["time"] = (const char *)time_buffer;
+  }
+  json["tags"]["device"] = settings.device_identifier;
+  json["fields"]["software"] = sketch_name + String(" Arduino sketch");
+  json["fields"]["software_version"] = version_stamp;
+  json["fields"]["healthy"] = 1;
+  add_upload_transport_stats(json["fields"].as<JsonObject>(), upload_client);
+  json["fields"]["upload_batched_bytes"] = sensor_engine.get_batch().get_batched_bytes(); // Since boot
+  json["fields"]["upload_sent_bytes"] = sensor_engine.get_batch().get_sent_bytes();       // Since boot, less than batched with gzip
+  json["fields"]["upload_batch_delay_msecs"] = sensor_engine.get_batch().get_effective_max_delay_msecs(); // Longer while the collector falls behind
+  json["fields"]["upload_resent_batches"] = sensor_engine.get_batch().get_resent_messages();             // Since boot, after the collector rejected them or didn't answer (http and https)
+  json["fields"]["upload_dropped_batches"] = sensor_engine.get_batch().get_dropped_messages();           // Since boot, never taken by the collector
+  if (settings.use_espnow_gateway)
+  {
+    // Since boot
+    const EspNowGatewayStats espnow_stats = espnow_gateway.get_stats();
+    json["fields"]["espnow_received"] = espnow_stats.received;
+    json["fields"]["espnow_invalid"] = espnow_stats.invalid;
+    json["fields"]["espnow_queue_overflows"] = espnow_stats.queue_overflows;
+    json["fields"]["espnow_duplicates"] = espnow_stats.duplicates;
+    json["fields"]["espnow_unknown_nodes"] = espnow_stats.unknown_nodes;
+    json["fields"]["espnow_forwarded"] = espnow_stats.forwarded;
+    json["fields"]["espnow_nodes"] = espnow_stats.node_count;
+  }
+
+  // Cpu time per sensor since the previous heartbeat
+  sensor_engine.for_each_stats([&json](const char *sensor_name, const SensorStats &stats)
+                               {
+                                 char field_name[48];
+                                 snprintf(field_name, sizeof(field_name), "%s_runs", sensor_name);
+                                 json["fields"][field_name] = stats.runs;
+                                 snprintf(field_name, sizeof(field_name), "%s_avg_micros", sensor_name);
+                                 json["fields"][field_name] = stats.runs > 0 ? stats.total_micros / stats.runs : 0;
+                                 snprintf(field_name, sizeof(field_name), "%s_max_micros", sensor_name);
+                                 json["fields"][field_name] = stats.max_micros;
+                               });
+  sensor_engine.reset_stats();
+
+  batch.add(json);
+}
+
+///                           ///
+// Helper function definitions //
+///                           ///
+
+// Transport specific setup, only WifiHttpsClient needs any (the non-template overload is picked for it)
+template <typename Transport>
+void configure_upload_transport(Transport &/* transport */)
+{
+}
+
+void configure_upload_transport(WifiHttpsClient &transport)
+{
+  transport.set_ca_cert(settings.collector_ca_cert);
+}
+
+// Transport specific heartbeat fields, only WifiHttpClient and WifiHttpsClient have any
+template <typename Transport>
+void add_upload_transport_stats(JsonObject /* fields */, Transport &/* transport */)
+{
+}
+
+void add_upload_transport_stats(JsonObject fields, WifiHttpClient &transport)
+{
+  add_http_response_stats(fields, transport.get_response_stats());
+}
+
+void add_upload_transport_stats(JsonObject fields, WifiHttpsClient &transport)
+{
+  const TlsStats &stats = transport.get_tls_stats();
+  fields["tls_full_handshakes"] = stats.full_handshakes;
+  fields["tls_resumed_handshakes"] = stats.resumed_handshakes;
+  fields["tls_failed_handshakes"] = stats.failed_handshakes;
+  fields["tls_last_handshake_micros"] = stats.last_handshake_micros;
+  add_http_response_stats(fields, transport.get_response_stats());
+}
+
+// Since boot, rejected messages were resent (upload_resent_batches) until taken or dropped (upload_dropped_batches)
+void add_http_response_stats(JsonObject fields, const HttpResponseStats &stats)
+{
+  fields["collector_responses"] = stats.responses;
+  fields["collector_throttled_responses"] = stats.throttled_responses;
+  fields["collector_rejected_messages"] = stats.rejected_messages;
+}
+
+// Converts a DSMR timestamp to nanoseconds since the unix epoch
+// Falls back to the SNTP-synced system clock when the timestamp can't be parsed
+// Returns false if neither is available
+bool dsmr_timestamp_to_unix_nsecs(const String &dsmr_timestamp, uint64_t *unix_time_nsecs)
+{
+  DsmrTimestamp parsed_timestamp;
+  if (dsmr_timestamp.length() >= 13 && parse_dsmr_timestamp(dsmr_timestamp.c_str(), &parsed_timestamp))
   {
-    // Create json object to send
-    // Use https://arduinojson.org/v6/assistant to get the recommended static document size
-    StaticJsonDocument<192> json; // Gets destroyed when leaving this scope
-
-    json["bucket"] = "heartbeat";
-    json["measurement"] = "heartbeat";
-    json["tags"]["device"] = settings.device_identifier;
-    json["fields"]["software"] = sketch_name + String(" Arduino sketch");
-    json["fields"]["software_version"] = version_stamp;
-    json["fields"]["healthy"] = 1;
-
-    serializeJson(json, json_string);
+    const int64_t unix_time_secs = dsmr_timestamp_to_unix_secs(
+        parsed_timestamp, settings.dsmr_utc_offset_winter_secs, settings.dsmr_utc_offset_summer_secs);
+    *unix_time_nsecs = (uint64_t)unix_time_secs * 1000000000ULL;
+    return true;
   }
-  wifi_http_client.send_post("/", json_string);
+  return get_unix_time_nsecs(unix_time_nsecs);
+}
+
+// Writes the nanosecond unix timestamp string of a DSMR timestamp to time_buffer (at least 21 chars)
+// Returns false if the time is unknown, the collector then uses the time of arrival
+bool dsmr_timestamp_to_time_string(const String &dsmr_timestamp, char *time_buffer)
+{
+  uint64_t unix_time_nsecs;
+  if (!dsmr_timestamp_to_unix_nsecs(dsmr_timestamp, &unix_time_nsecs))
+    return false;
+
+  u64_to_decimal(unix_time_nsecs, time_buffer);
+  return true;
 }
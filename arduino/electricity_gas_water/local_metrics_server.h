@@ -0,0 +1,352 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <WiFi.h>
+#include <snapshot_buffer.h>
+#include <fixed_decimal.h>
+
+#include "dsmr_wrapper.h"
+#include "time_util.h"
+
+///                               ///
+// Struct declarations and helpers //
+///                               ///
+
+// Names of the values in DsmrSnapshot::milli_values, in order (see make_dsmr_snapshot)
+static constexpr const char *dsmr_snapshot_field_names[] = {
+    "energy_delivered_tariff1", // kWh
+    "energy_delivered_tariff2", // kWh
+    "energy_returned_tariff1",  // kWh
+    "energy_returned_tariff2",  // kWh
+    "power_delivered",          // kW
+    "power_delivered_l1",       // kW
+    "power_delivered_l2",       // kW
+    "power_delivered_l3",       // kW
+    "power_returned",           // kW
+    "power_returned_l1",        // kW
+    "power_returned_l2",        // kW
+    "power_returned_l3",        // kW
+    "voltage_l1",               // V
+    "voltage_l2",               // V
+    "voltage_l3",               // V
+    "current_l1",               // A
+    "current_l2",               // A
+    "current_l3",               // A
+    "gas_m3",                   // m3
+};
+static constexpr size_t dsmr_snapshot_field_count = sizeof(dsmr_snapshot_field_names) / sizeof(dsmr_snapshot_field_names[0]);
+
+// The last telegram, reduced to what the local metrics server serves
+struct DsmrSnapshot
+{
+  uint32_t telegram_count;                          // Telegrams received since boot
+  uint64_t unix_time_nsecs;                         // 0 if unknown
+  uint32_t milli_values[dsmr_snapshot_field_count]; // In dsmr_snapshot_field_names order, FixedValue milli-units
+};
+
+// Keep in sync with dsmr_snapshot_field_names
+DsmrSnapshot make_dsmr_snapshot(FluviusDSMRData &message, const uint32_t telegram_count, const uint64_t unix_time_nsecs)
+{
+  DsmrSnapshot snapshot;
+  snapshot.telegram_count = telegram_count;
+  snapshot.unix_time_nsecs = unix_time_nsecs;
+
+  uint32_t *value = snapshot.milli_values;
+  *value++ = message.energy_delivered_tariff1.int_val();
+  *value++ = message.energy_delivered_tariff2.int_val();
+  *value++ = message.energy_returned_tariff1.int_val();
+  *value++ = message.energy_returned_tariff2.int_val();
+  *value++ = message.power_delivered.int_val();
+  *value++ = message.power_delivered_l1.int_val();
+  *value++ = message.power_delivered_l2.int_val();
+  *value++ = message.power_delivered_l3.int_val();
+  *value++ = message.power_returned.int_val();
+  *value++ = message.power_returned_l1.int_val();
+  *value++ = message.power_returned_l2.int_val();
+  *value++ = message.power_returned_l3.int_val();
+  *value++ = message.voltage_l1.int_val();
+  *value++ = message.voltage_l2.int_val();
+  *value++ = message.voltage_l3.int_val();
+  *value++ = message.current_l1_redef.int_val();
+  *value++ = message.current_l2_redef.int_val();
+  *value++ = message.current_l3_redef.int_val();
+  *value++ = message.gas_m3.int_val();
+  assert(value == snapshot.milli_values + dsmr_snapshot_field_count);
+
+  return snapshot;
+}
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Read-only http server for the lan, serving the latest DsmrSnapshot as:
+ *   - /metrics: Prometheus text format
+ *   - /latest.json: A flat json object
+ * Runs in its own task on the other core, so slow clients never delay reading DSMR telegrams.
+ * The acquisition path only ever publishes to the lock-free snapshot, responses are written straight to the socket.
+ * At most max_clients connections are handled at once, others wait in the listen backlog.
+ */
+class LocalMetricsServer
+{
+public:
+  static constexpr uint8_t max_clients_limit = 8;
+
+  LocalMetricsServer(const uint16_t port, const uint8_t max_clients, const uint32_t client_timeout_msecs = 2000);
+
+  void init();
+  // Only call from a single task
+  void publish(const DsmrSnapshot &snapshot);
+
+private:
+  struct ClientSlot
+  {
+    WiFiClient client;
+    bool is_active = false;
+    uint32_t accepted_timestamp_msecs = 0;
+    char request_line[48];
+    uint8_t request_line_length = 0;
+    bool is_request_line_complete = false;
+    uint32_t header_end_state = 0; // Last received chars, to detect the empty line ending the headers
+  };
+
+  static void task_entrypoint(void *instance);
+  void poll_clients();
+  bool read_request(ClientSlot &slot);
+  void respond(ClientSlot &slot);
+  void write_metrics(WiFiClient &client, const DsmrSnapshot &snapshot);
+  void write_latest_json(WiFiClient &client, const DsmrSnapshot &snapshot);
+
+private:
+  bool is_initialized = false;
+  const uint8_t max_clients;
+  const uint32_t client_timeout_msecs;
+  WiFiServer server;
+  ClientSlot slots[max_clients_limit];
+  DoubleBufferedSnapshot<DsmrSnapshot> latest_snapshot;
+};
+
+/*
+ * Collects a response in a small stack buffer and writes it to the socket in chunks.
+ */
+class SocketResponseWriter
+{
+public:
+  SocketResponseWriter(WiFiClient &client) : client(client) {}
+  ~SocketResponseWriter() { flush(); }
+
+  void write(const char *str)
+  {
+    while (*str != '\0')
+    {
+      if (used == sizeof(buffer))
+        flush();
+      buffer[used++] = *str++;
+    }
+  }
+
+  void write_milli_value(int64_t milli_value)
+  {
+    if (used + milli_value_max_length > sizeof(buffer))
+      flush();
+    used += format_milli_value(milli_value, buffer + used);
+  }
+
+  void write_u64(uint64_t value)
+  {
+    char digits[21];
+    u64_to_decimal(value, digits);
+    write(digits);
+  }
+
+  void flush()
+  {
+    if (used > 0)
+      client.write((const uint8_t *)buffer, used);
+    used = 0;
+  }
+
+private:
+  WiFiClient &client;
+  char buffer[256];
+  size_t used = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+LocalMetricsServer::LocalMetricsServer(const uint16_t port, const uint8_t max_clients, const uint32_t client_timeout_msecs)
+    : max_clients(max_clients < max_clients_limit ? max_clients : max_clients_limit),
+      client_timeout_msecs(client_timeout_msecs),
+      server(port, max_clients)
+{
+}
+
+void LocalMetricsServer::init()
+{
+  assert(!is_initialized); // Ensure this is only called once
+
+  server.begin();
+  server.setNoDelay(true);
+
+  // Core 1 runs loop(), which reads the DSMR uart
+  xTaskCreatePinnedToCore(task_entrypoint, "local_metrics_server", 4096, this, 1, nullptr, 0);
+
+  is_initialized = true;
+}
+
+void LocalMetricsServer::publish(const DsmrSnapshot &snapshot)
+{
+  latest_snapshot.publish(snapshot);
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+void LocalMetricsServer::task_entrypoint(void *instance)
+{
+  while (true)
+  {
+    static_cast<LocalMetricsServer *>(instance)->poll_clients();
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+}
+
+void LocalMetricsServer::poll_clients()
+{
+  for (uint8_t i = 0; i < max_clients; i++)
+  {
+    ClientSlot &slot = slots[i];
+
+    if (!slot.is_active)
+    {
+      // Only accept when there is a free slot, so excess clients wait in the backlog
+      WiFiClient client = server.available();
+      if (!client)
+        continue;
+      slot.client = client;
+      slot.is_active = true;
+      slot.accepted_timestamp_msecs = millis();
+      slot.request_line_length = 0;
+      slot.is_request_line_complete = false;
+      slot.header_end_state = 0;
+    }
+
+    if (read_request(slot))
+    {
+      respond(slot);
+    }
+    else if (slot.client.connected() && millis() - slot.accepted_timestamp_msecs < client_timeout_msecs)
+    {
+      continue; // The request is not complete yet
+    }
+
+    slot.client.stop();
+    slot.is_active = false;
+  }
+}
+
+// Returns true once the full request head was received
+bool LocalMetricsServer::read_request(ClientSlot &slot)
+{
+  while (slot.client.available() > 0)
+  {
+    const char c = slot.client.read();
+
+    if (!slot.is_request_line_complete)
+    {
+      if (c == '\r' || c == '\n')
+        slot.is_request_line_complete = true;
+      else if (slot.request_line_length < sizeof(slot.request_line) - 1)
+        slot.request_line[slot.request_line_length++] = c;
+    }
+
+    // Headers end with "\r\n\r\n" (or "\n\n")
+    slot.header_end_state = (slot.header_end_state << 8) | (uint8_t)c;
+    if (slot.header_end_state == 0x0d0a0d0a || (slot.header_end_state & 0xffff) == 0x0a0a)
+    {
+      slot.request_line[slot.request_line_length] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+void LocalMetricsServer::respond(ClientSlot &slot)
+{
+  WiFiClient &client = slot.client;
+  const char *request_line = slot.request_line;
+
+  const bool is_metrics = strncmp(request_line, "GET /metrics ", 13) == 0;
+  const bool is_latest_json = strncmp(request_line, "GET /latest.json ", 17) == 0;
+  if (!is_metrics && !is_latest_json)
+  {
+    client.print(F("HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"));
+    return;
+  }
+
+  DsmrSnapshot snapshot;
+  if (!latest_snapshot.read(&snapshot))
+  {
+    client.print(F("HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"));
+    return;
+  }
+
+  if (is_metrics)
+    write_metrics(client, snapshot);
+  else
+    write_latest_json(client, snapshot);
+}
+
+void LocalMetricsServer::write_metrics(WiFiClient &client, const DsmrSnapshot &snapshot)
+{
+  SocketResponseWriter writer(client);
+  writer.write("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+
+  writer.write("fluvius_smart_meter_telegram_count ");
+  writer.write_u64(snapshot.telegram_count);
+  writer.write("\n");
+
+  for (size_t i = 0; i < dsmr_snapshot_field_count; i++)
+  {
+    writer.write("fluvius_smart_meter_");
+    writer.write(dsmr_snapshot_field_names[i]);
+    writer.write(" ");
+    writer.write_milli_value(snapshot.milli_values[i]);
+    if (snapshot.unix_time_nsecs != 0)
+    {
+      writer.write(" ");
+      writer.write_u64(snapshot.unix_time_nsecs / 1000000); // Prometheus wants milliseconds
+    }
+    writer.write("\n");
+  }
+}
+
+void LocalMetricsServer::write_latest_json(WiFiClient &client, const DsmrSnapshot &snapshot)
+{
+  SocketResponseWriter writer(client);
+  writer.write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n");
+
+  writer.write("{\"telegram_count\":");
+  writer.write_u64(snapshot.telegram_count);
+  if (snapshot.unix_time_nsecs != 0)
+  {
+    writer.write(",\"time\":\"");
+    writer.write_u64(snapshot.unix_time_nsecs);
+    writer.write("\"");
+  }
+  for (size_t i = 0; i < dsmr_snapshot_field_count; i++)
+  {
+    writer.write(",\"");
+    writer.write(dsmr_snapshot_field_names[i]);
+    writer.write("\":");
+    writer.write_milli_value(snapshot.milli_values[i]);
+  }
+  writer.write("}");
+}
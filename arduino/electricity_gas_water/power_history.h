@@ -0,0 +1,113 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stdint.h>
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Lowest and highest power seen during one column of a PowerHistory, in W
+struct PowerHistoryColumn
+{
+  int32_t min_power;
+  int32_t max_power;
+
+  bool is_empty() const { return min_power > max_power; } // No samples during this column
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Rolling history of the net power over the last window_msecs, for the graph on the display.
+ * The window is split into column_count columns (one per pixel column), each holding the min and max power
+ * of its samples. Columns are kept in a static ring, so memory and the cost of add(...) don't depend on the window length.
+ * Readers track get_total_column_count() to find out how many columns were started since they last looked.
+ */
+template <uint16_t column_count>
+class PowerHistory
+{
+public:
+  PowerHistory(const uint32_t window_msecs);
+
+  void add(const int32_t power, const uint32_t timestamp_msecs);
+
+  // Columns that hold data (or were skipped), at most column_count
+  uint16_t get_filled_column_count() const { return filled_column_count; }
+  // age 0 = the newest column, which still receives samples
+  const PowerHistoryColumn &get_column(const uint16_t age) const { return columns[(newest_index + column_count - age) % column_count]; }
+  // Columns started since boot, wraps around
+  uint32_t get_total_column_count() const { return total_column_count; }
+
+private:
+  void start_column(const PowerHistoryColumn &column);
+
+private:
+  const uint32_t column_msecs;
+
+  PowerHistoryColumn columns[column_count];
+  uint16_t newest_index = column_count - 1; // The first column goes to index 0
+  uint16_t filled_column_count = 0;
+  uint32_t total_column_count = 0;
+  uint32_t column_start_msecs = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <uint16_t column_count>
+PowerHistory<column_count>::PowerHistory(const uint32_t window_msecs)
+    : column_msecs(window_msecs / column_count > 0 ? window_msecs / column_count : 1)
+{
+}
+
+template <uint16_t column_count>
+void PowerHistory<column_count>::add(const int32_t power, const uint32_t timestamp_msecs)
+{
+  if (filled_column_count == 0)
+  {
+    column_start_msecs = timestamp_msecs;
+    start_column({power, power});
+    return;
+  }
+
+  uint32_t elapsed_columns = (timestamp_msecs - column_start_msecs) / column_msecs;
+  if (elapsed_columns == 0)
+  {
+    PowerHistoryColumn &column = columns[newest_index];
+    if (power < column.min_power)
+      column.min_power = power;
+    if (power > column.max_power)
+      column.max_power = power;
+    return;
+  }
+
+  // Columns without any samples (e.g. while no telegrams arrived) stay empty, more than a whole window is the same as a whole window
+  column_start_msecs += elapsed_columns * column_msecs;
+  if (elapsed_columns > column_count)
+    elapsed_columns = column_count;
+  for (uint32_t i = 1; i < elapsed_columns; i++)
+    start_column({INT32_MAX, INT32_MIN});
+  start_column({power, power});
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+template <uint16_t column_count>
+void PowerHistory<column_count>::start_column(const PowerHistoryColumn &column)
+{
+  newest_index = (newest_index + 1) % column_count;
+  columns[newest_index] = column;
+
+  if (filled_column_count < column_count)
+    filled_column_count++;
+  total_column_count++;
+}
@@ -12,6 +12,8 @@
 #include <TFT_eSPI.h>
 #include <SPI.h>
 
+#include "power_history.h"
+
 ///                 ///
 // Class declaration //
 ///                 ///
@@ -19,13 +21,32 @@
 class TftDisplayWrapper
 {
 public:
+  // The power graph spans the bottom of a 240x135 display (TTGO T-Display in landscape), below the metrics
+  static constexpr uint16_t power_graph_width = 240;
+  static constexpr uint16_t power_graph_height = 26;
+  static constexpr int32_t power_graph_y = 109;
+  static constexpr int32_t power_graph_scale_step_w = 500; // The graph's range is rounded to this, so it rarely changes
+
   void init();
   void draw_sketch_version(const String &version_stamp);
-  void draw_metrics(const int32_t &power_consumption, const float &battery_current, const int32_t &teller_stand_water, const String &wifi_ssid);
+  // Shows the predicted quarter-hour average instead of the ssid while show_peak_warning is set
+  void draw_metrics(const int32_t &power_consumption, const float &battery_current, const int32_t &teller_stand_water, const String &wifi_ssid,
+                    const bool &show_peak_warning, const uint32_t &predicted_quarter_average_power);
+  // Only draws the columns that changed since the last call, unless the graph's range changed
+  void draw_power_history(const PowerHistory<power_graph_width> &history);
+
+private:
+  void draw_power_graph_column(const PowerHistoryColumn &column, const int16_t x);
+  int16_t power_to_graph_y(const int32_t power) const;
 
 private:
   bool is_initialized = false;
   TFT_eSPI tft;
+
+  TFT_eSprite power_graph{&tft}; // Scrolled one column at a time, then pushed to the display as a whole
+  int32_t power_graph_min_power = 0;
+  int32_t power_graph_max_power = 0;
+  uint32_t drawn_power_history_column_count = 0;
 };
 
 ///                                   ///
@@ -39,6 +60,9 @@ void TftDisplayWrapper::init()
   tft.init();
   tft.setRotation(3); // 3 = upside-down
 
+  power_graph.setColorDepth(8); // Half the memory of 16 bit, plenty for a few colors
+  power_graph.createSprite(power_graph_width, power_graph_height);
+
   is_initialized = true;
 }
 
@@ -63,29 +87,38 @@ void TftDisplayWrapper::draw_sketch_version(const String &version_stamp)
   tft.drawString(String(" IDE version: ") + String(__VERSION__), 0, 96, 4);
 }
 
-void TftDisplayWrapper::draw_metrics(const int32_t &power_consumption, const float &battery_current, const int32_t &teller_stand_water, const String &wifi_ssid)
+void TftDisplayWrapper::draw_metrics(const int32_t &power_consumption, const float &battery_current, const int32_t &teller_stand_water, const String &wifi_ssid,
+                                     const bool &show_peak_warning, const uint32_t &predicted_quarter_average_power)
 {
   assert(is_initialized); // Ensure init() was called
 
-  tft.fillScreen(TFT_BLACK);
+  tft.fillRect(0, 0, tft.width(), power_graph_y, TFT_BLACK); // Leaves the power graph alone
   tft.setTextSize(1);
   int32_t x = 10;
-  int32_t y = 10;
+  int32_t y = 4;
   
   tft.setTextColor(power_consumption > 0 ? TFT_RED : TFT_GREEN, TFT_BLACK);
   tft.drawString(String("PCons=") + String(power_consumption), x, y, 4);
-  y += 30;
+  y += 26;
 
   tft.setTextColor(battery_current > 0 ? TFT_GREEN : TFT_ORANGE, TFT_BLACK);
   tft.drawString(String("BattCurr=") + String(battery_current, 2), x, y, 4);
-  y += 30;
+  y += 26;
 
   tft.setTextColor(TFT_BLUE, TFT_BLACK);
   tft.drawString(String("Water=") + String(teller_stand_water), x, y, 4);
-  y += 30;
-
-  tft.setTextColor(TFT_WHITE, TFT_BLACK);
-  tft.drawString(String("SSID=") + String(wifi_ssid), x, y, 4);
+  y += 26;
+
+  if (show_peak_warning)
+  {
+    tft.setTextColor(TFT_WHITE, TFT_RED);
+    tft.drawString(String("PEAK=") + String(predicted_quarter_average_power), x, y, 4);
+  }
+  else
+  {
+    tft.setTextColor(TFT_WHITE, TFT_BLACK);
+    tft.drawString(String("SSID=") + String(wifi_ssid), x, y, 4);
+  }
 
   // tft.setTextSize(1);
   // tft.setTextColor(TFT_BLUE, TFT_BLACK);
@@ -94,3 +127,83 @@ void TftDisplayWrapper::draw_metrics(const int32_t &power_consumption, const flo
 
   // tft.drawString(String(TellerStandGas_delta) + String("   Delta/min"), 40, 80, 4);
 }
+
+void TftDisplayWrapper::draw_power_history(const PowerHistory<power_graph_width> &history)
+{
+  assert(is_initialized); // Ensure init() was called
+
+  // Range of the graph, always including 0
+  const uint16_t filled_column_count = history.get_filled_column_count();
+  int32_t min_power = 0;
+  int32_t max_power = 0;
+  for (uint16_t age = 0; age < filled_column_count; age++)
+  {
+    const PowerHistoryColumn &column = history.get_column(age);
+    if (column.is_empty())
+      continue;
+    if (column.min_power < min_power)
+      min_power = column.min_power;
+    if (column.max_power > max_power)
+      max_power = column.max_power;
+  }
+  min_power = -((-min_power + power_graph_scale_step_w - 1) / power_graph_scale_step_w) * power_graph_scale_step_w;
+  max_power = ((max_power + power_graph_scale_step_w - 1) / power_graph_scale_step_w) * power_graph_scale_step_w;
+  if (min_power == max_power)
+    max_power = power_graph_scale_step_w;
+
+  const uint32_t new_column_count = history.get_total_column_count() - drawn_power_history_column_count;
+  drawn_power_history_column_count = history.get_total_column_count();
+
+  if (min_power != power_graph_min_power || max_power != power_graph_max_power || new_column_count >= power_graph_width)
+  {
+    // Every column is at a different height now
+    power_graph_min_power = min_power;
+    power_graph_max_power = max_power;
+    const PowerHistoryColumn empty_column = {INT32_MAX, INT32_MIN};
+    for (uint16_t age = 0; age < power_graph_width; age++)
+      draw_power_graph_column(age < filled_column_count ? history.get_column(age) : empty_column, power_graph_width - 1 - age);
+  }
+  else
+  {
+    // Shift the finished columns to the left, then draw the new columns and the previous newest one (it may have received samples since)
+    if (new_column_count > 0)
+      power_graph.scroll(-(int16_t)new_column_count, 0);
+    for (uint16_t age = 0; age <= new_column_count && age < filled_column_count; age++)
+      draw_power_graph_column(history.get_column(age), power_graph_width - 1 - age);
+  }
+
+  power_graph.pushSprite(0, power_graph_y);
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+// Consumption (above the zero line) in red, injection (below it) in green
+void TftDisplayWrapper::draw_power_graph_column(const PowerHistoryColumn &column, const int16_t x)
+{
+  power_graph.drawFastVLine(x, 0, power_graph_height, TFT_BLACK);
+  const int16_t zero_y = power_to_graph_y(0);
+  power_graph.drawPixel(x, zero_y, TFT_DARKGREY);
+
+  if (column.is_empty())
+    return;
+
+  if (column.max_power > 0)
+  {
+    const int16_t top_y = power_to_graph_y(column.max_power);
+    const int16_t bottom_y = power_to_graph_y(column.min_power > 0 ? column.min_power : 0);
+    power_graph.drawFastVLine(x, top_y, bottom_y - top_y + 1, TFT_RED);
+  }
+  if (column.min_power < 0)
+  {
+    const int16_t top_y = power_to_graph_y(column.max_power < 0 ? column.max_power : 0);
+    const int16_t bottom_y = power_to_graph_y(column.min_power);
+    power_graph.drawFastVLine(x, top_y, bottom_y - top_y + 1, TFT_GREEN);
+  }
+}
+
+int16_t TftDisplayWrapper::power_to_graph_y(const int32_t power) const
+{
+  return (int16_t)((int64_t)(power_graph_max_power - power) * (power_graph_height - 1) / (power_graph_max_power - power_graph_min_power));
+}
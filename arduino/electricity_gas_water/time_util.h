@@ -0,0 +1,117 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <time.h>
+#include <sys/time.h>
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Broken down local time as found in DSMR telegrams
+struct DsmrTimestamp
+{
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  bool is_summer_time;
+};
+
+///                    ///
+// Function definitions //
+///                    ///
+
+// Parses a DSMR timestamp of the form "YYMMDDhhmmssX" (X is 'S' for summer time, 'W' for winter time)
+// Only reads from str, never allocates
+bool parse_dsmr_timestamp(const char *str, DsmrTimestamp *out)
+{
+  uint8_t digits[12];
+  for (uint8_t i = 0; i < 12; i++)
+  {
+    if (str[i] < '0' || str[i] > '9')
+      return false;
+    digits[i] = str[i] - '0';
+  }
+  if (str[12] != 'S' && str[12] != 'W')
+    return false;
+
+  out->year = 2000 + digits[0] * 10 + digits[1];
+  out->month = digits[2] * 10 + digits[3];
+  out->day = digits[4] * 10 + digits[5];
+  out->hour = digits[6] * 10 + digits[7];
+  out->minute = digits[8] * 10 + digits[9];
+  out->second = digits[10] * 10 + digits[11];
+  out->is_summer_time = str[12] == 'S';
+
+  return out->month >= 1 && out->month <= 12 && out->day >= 1 && out->day <= 31 &&
+         out->hour <= 23 && out->minute <= 59 && out->second <= 59;
+}
+
+// Days since 1970-01-01 of a (proleptic gregorian) date
+// See http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+int32_t days_from_civil(int32_t year, uint32_t month, uint32_t day)
+{
+  year -= month <= 2;
+  const int32_t era = (year >= 0 ? year : year - 399) / 400;
+  const uint32_t year_of_era = (uint32_t)(year - era * 400);
+  const uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  const uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + (int32_t)day_of_era - 719468;
+}
+
+// Converts a local DSMR timestamp to utc seconds since the unix epoch
+int64_t dsmr_timestamp_to_unix_secs(const DsmrTimestamp &timestamp, int32_t utc_offset_winter_secs, int32_t utc_offset_summer_secs)
+{
+  const int64_t local_secs =
+      (int64_t)days_from_civil(timestamp.year, timestamp.month, timestamp.day) * 86400 +
+      timestamp.hour * 3600 + timestamp.minute * 60 + timestamp.second;
+  return local_secs - (timestamp.is_summer_time ? utc_offset_summer_secs : utc_offset_winter_secs);
+}
+
+// Writes value as a null-terminated decimal string, buffer must hold at least 21 chars
+// Returns the string length
+size_t u64_to_decimal(uint64_t value, char *buffer)
+{
+  char reversed[20];
+  size_t length = 0;
+  do
+  {
+    reversed[length++] = '0' + (value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  for (size_t i = 0; i < length; i++)
+    buffer[i] = reversed[length - 1 - i];
+  buffer[length] = '\0';
+  return length;
+}
+
+// Starts keeping the system clock in sync with an NTP server (in the background, also works before wifi is connected)
+void start_sntp_sync(const char *ntp_server_address)
+{
+  configTime(0, 0, ntp_server_address); // utc, no dst offset
+}
+
+// The system clock starts at the unix epoch on boot, so anything before 2020 means no NTP response was received yet
+bool is_time_synced()
+{
+  return time(nullptr) > 1577836800; // 2020-01-01T00:00:00Z
+}
+
+// Returns false if the system clock was never synced
+bool get_unix_time_nsecs(uint64_t *out)
+{
+  if (!is_time_synced())
+    return false;
+
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  *out = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_usec * 1000ULL;
+  return true;
+}
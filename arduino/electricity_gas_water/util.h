@@ -1,31 +1,31 @@
 #pragma once
 
-#define byte char
-#define ubyte unsigned char
+#include <ArduinoJson.h>
+#include <home_monitoring_util.h>
+#include <fixed_decimal.h>
 
-void print_sketch_version(const String &version_stamp, const String &file_name)
-{
-  Serial.println(String("Sketch File    : ") + file_name);
-  Serial.println(String("Sketch version : ") + version_stamp);
-  Serial.println(
-      String("Compiled: ") + String(__DATE__) + String(", ") + String(__TIME__) + String(", IDE version: ") + String(__VERSION__) + String("\n"));
-}
+#include "dsmr.h"
 
-// Runs for the first time when millis() == interval_msecs
-template <typename T>
-void run_in_interval_nonblocking(uint32_t *const state, const uint32_t interval_msecs, T func)
+/*
+ * Formats FixedValue fields for a json document straight from their integer milli-units,
+ * without float math or a heap String per field.
+ * The json document only stores pointers into the buffer, so a formatter must outlive the serialization of that document.
+ */
+template <size_t capacity>
+class FixedValueJsonFormatter
 {
-  uint32_t &last_send_timestamp_msecs = *state;
-
-  const uint32_t curr_timestamp_msecs = millis();
-  if (curr_timestamp_msecs < last_send_timestamp_msecs) // Detect millis() overflow
-    last_send_timestamp_msecs = 0;
-  const uint32_t msecs_since_last_send = curr_timestamp_msecs - last_send_timestamp_msecs;
-  if (msecs_since_last_send >= interval_msecs)
+public:
+  SerializedValue<const char *> format(FixedValue &fixed_value)
   {
-    last_send_timestamp_msecs = curr_timestamp_msecs;
-    func();
+    assert(used + milli_value_max_length <= capacity); // Ensure the buffer is large enough for all fields
+
+    char *start = buffer + used;
+    const size_t length = format_milli_value(fixed_value.int_val(), start);
+    used += length;
+    return serialized((const char *)start, length);
   }
-}
 
-#define fixed_value_to_json_float(fixed_value) serialized(String(fixed_value.val(), 3))
+private:
+  char buffer[capacity];
+  size_t used = 0;
+};
@@ -0,0 +1,115 @@
+// Battery-powered sensor node: wakes up, sends one reading over esp-now to the electricity_gas_water sketch
+// (with use_espnow_gateway enabled), and goes back to deep sleep. It never connects to the access point, which
+// takes far longer (and more energy) than sending a single esp-now frame.
+// Install dependencies with:
+//   - Set additional board manager urls in settings to:
+//       https://arduino.esp8266.com/stable/package_esp8266com_index.json
+//       https://raw.githubusercontent.com/espressif/arduino-esp32/gh-pages/package_esp32_index.json
+//   - Install esp32 or esp8266 boards through the board manager
+//   - Set the sketchbook location (File -> Preferences) to the "arduino" folder of this repository (for the HomeMonitoring library)
+// On esp8266, connect GPIO16 (D0) to RST so the timer can wake it up from deep sleep.
+
+///        ///
+// Includes //
+///        ///
+
+#include <espnow_node.h>
+
+#include "settings.h" // Create by copying settings.h.example to settings.h and filling in the dummy values
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Kept in rtc memory, which survives deep sleep but not a power cycle
+struct SequenceState
+{
+  uint32_t session; // 0 = not picked yet (cold boot)
+  uint32_t sequence;
+};
+
+///       ///
+// Globals //
+///       ///
+
+#ifdef ESP32
+RTC_DATA_ATTR SequenceState sequence_state = {}; // Zeroed on cold boot
+#else
+SequenceState sequence_state = {}; // Copied from and to rtc user memory, see load_sequence_state
+#endif
+
+EspNowRadio radio;
+
+///                     ///
+// Function declarations //
+///                     ///
+
+void setup();
+void loop();
+void load_sequence_state();
+void store_sequence_state();
+int32_t read_milli_value();
+
+///                    ///
+// Function definitions //
+///                    ///
+
+void setup()
+{
+  if (settings.use_serial)
+    Serial.begin(115200);
+
+  load_sequence_state();
+  if (sequence_state.session == 0)
+  {
+    // New session, so the gateway doesn't drop the restarted sequence numbers as duplicates
+    randomSeed(micros() ^ analogRead(A0));
+    sequence_state.session = (uint32_t)random(1, 0x7fffffff) | 1;
+    sequence_state.sequence = 0;
+  }
+
+  const int32_t milli_value = read_milli_value();
+
+  EspNowNode<EspNowRadio> node(radio, settings.gateway_mac, sequence_state.session, sequence_state.sequence, settings.max_send_attempts);
+  const bool is_sent = radio.begin(settings.gateway_mac, settings.espnow_channel) && node.send_reading(settings.measurement, &milli_value, 1);
+  store_sequence_state();
+
+  if (settings.use_serial)
+  {
+    Serial.print("Reading ");
+    Serial.print(sequence_state.sequence);
+    Serial.println(is_sent ? " acknowledged" : " not acknowledged");
+    Serial.flush();
+  }
+
+  ESP.deepSleep((uint64_t)settings.sleep_interval_msecs * 1000);
+}
+
+void loop()
+{
+  // Never reached, every wake-up starts over in setup()
+}
+
+void load_sequence_state()
+{
+#ifdef ESP8266
+  // Rtc user memory holds garbage after a power cycle
+  if (ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE)
+    ESP.rtcUserMemoryRead(0, (uint32_t *)&sequence_state, sizeof(sequence_state));
+  else
+    sequence_state = {};
+#endif
+}
+
+void store_sequence_state()
+{
+#ifdef ESP8266
+  ESP.rtcUserMemoryWrite(0, (uint32_t *)&sequence_state, sizeof(sequence_state));
+#endif
+}
+
+// Replace with the actual sensor, values are sent in milli-units (1.234 m is 1234)
+int32_t read_milli_value()
+{
+  return random(1000, 10000);
+}
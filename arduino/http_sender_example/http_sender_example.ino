@@ -4,6 +4,7 @@
 //       https://raw.githubusercontent.com/espressif/arduino-esp32/gh-pages/package_esp32_index.json
 //   - Install esp8266 boards through the board manager (contains a good WiFiClient.h for arduinos)
 //   - Install ArduinoJson through the library manager
+//   - Set the sketchbook location (File -> Preferences) to the "arduino" folder of this repository (for the HomeMonitoring library)
 
 ///        ///
 // Includes //
@@ -11,11 +12,28 @@
 
 #include <ArduinoJson.h>
 
-#include "wifi_http_client.h"
-#include "util.h"
+#include <wifi_http_client.h>
+#include <sensor_engine.h>
 
 #include "settings.h" // Create by copying settings.h.example to settings.h and filling in the dummy values
 
+///                   ///
+// Struct declarations //
+///                   ///
+
+using Batch = PointBatch<WifiHttpClient, 512>;
+
+struct WaterDepthSensor
+{
+  static constexpr const char *name = "water_depth";
+  uint32_t interval_msecs() const { return settings.send_interval_msecs; }
+  bool sample();
+  void encode(Batch &batch);
+
+private:
+  float value = 0;
+};
+
 ///       ///
 // Globals //
 ///       ///
@@ -24,6 +42,7 @@ WifiHttpClient client(
     settings.wifi_ssid, settings.wifi_pass,
     settings.http_server_address, settings.http_server_port,
     settings.use_serial);
+SensorEngine<WifiHttpClient, 512, WaterDepthSensor> sensor_engine(client, 0); // No batching delay, every point is sent right away
 
 ///                     ///
 // Function declarations //
@@ -31,7 +50,6 @@ WifiHttpClient client(
 
 void setup();
 void loop();
-void read_and_send_data();
 
 ///                    ///
 // Function definitions //
@@ -47,37 +65,35 @@ void setup()
 void loop()
 {
   client.reconnect_if_needed();
-
-  // Call read_and_send_data() every send_interval_msecs
-  {
-    static uint32_t state = 0;
-    run_in_interval_nonblocking(&state, settings.send_interval_msecs, read_and_send_data);
-  }
+  sensor_engine.run(); // Runs WaterDepthSensor every send_interval_msecs
 }
 
-void read_and_send_data()
+///                             ///
+// Sensor method implementations //
+///                             ///
+
+bool WaterDepthSensor::sample()
 {
-  float value = (float)random(1, 10);
+  value = (float)random(1, 10);
   if (settings.use_serial)
   {
     Serial.print("Value: ");
     Serial.println(value);
   }
+  return true;
+}
 
-  String json_string;
-  {
-    // Create json object to send
-    // Use https://arduinojson.org/v6/assistant to get the recommended static document size
-    // Example json: See project readme file
-    StaticJsonDocument<192> json; // Gets destroyed when leaving this scope
-
-    json["bucket"] = "default";
-    json["measurement"] = "water_depth";
-    json["tags"]["location"] = "some_canal";
-    json["fields"]["depth_in_meters"] = value;
+void WaterDepthSensor::encode(Batch &batch)
+{
+  // Create json object to send
+  // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+  // Example json: See project readme file
+  StaticJsonDocument<192> json; // Gets destroyed when leaving this scope
 
-    serializeJson(json, json_string);
-  }
+  json["bucket"] = "default";
+  json["measurement"] = "water_depth";
+  json["tags"]["location"] = "some_canal";
+  json["fields"]["depth_in_meters"] = value;
 
-  client.send_post("/", json_string);
-};
+  batch.add(json);
+}
@@ -0,0 +1,303 @@
+// Host benchmark of the binary wire format: encode time and size of a BinaryPoint versus the json data point of the
+// electricity_gas_water sketch, on generated electricity readings
+//
+// Build and run (from this folder):
+//   g++ -O2 -std=c++17 -I../../src binary_point_benchmark.cpp -o binary_point_benchmark && ./binary_point_benchmark
+// This times the json text written straight into a buffer, a lower bound of what the sketch spends on it.
+// Also time the sketch's actual StaticJsonDocument<768> + serializeJson path (ArduinoJson 6 sources, e.g. from the Arduino libraries folder),
+// which is checked to produce the same text:
+//   g++ -O2 -std=c++17 -DWITH_ARDUINOJSON -I<ArduinoJson>/src -I../../src binary_point_benchmark.cpp -o binary_point_benchmark && ./binary_point_benchmark
+
+///        ///
+// Includes //
+///        ///
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#ifdef WITH_ARDUINOJSON
+#include <ArduinoJson.h>
+#endif
+
+#include "binary_point.h"
+#include "binary_schemas.h"
+#include "fixed_decimal.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// The values encode_electricity reads from FluviusDSMRData, as milli-units where the sketch has a FixedValue
+struct ElectricityReading
+{
+  uint64_t unix_time_nsecs;
+  uint32_t sequence;
+  uint32_t values[(uint8_t)FluviusElectricityField::field_count];
+};
+
+///         ///
+// Constants //
+///         ///
+
+constexpr size_t batch_capacity = 4096; // upload_batch_capacity in the electricity_gas_water settings.h.example
+constexpr uint32_t reading_count = 1000;
+constexpr uint32_t iterations = 200;
+constexpr uint32_t descriptor_id = 3127840517;
+const char *const trace_source = "esp32-electricity";
+
+const char *const electricity_field_names[] = {
+    "electricity_switch_position", "electricity_threshold", "current_max", "electricity_tariff",
+    "energy_delivered_tariff1", "energy_delivered_tariff2", "energy_returned_tariff1", "energy_returned_tariff2",
+    "power_delivered", "power_delivered_l1", "power_delivered_l2", "power_delivered_l3",
+    "power_returned", "power_returned_l1", "power_returned_l2", "power_returned_l3",
+    "voltage_l1", "voltage_l2", "voltage_l3", "current_l1", "current_l2", "current_l3"};
+
+///       ///
+// Globals //
+///       ///
+
+ElectricityReading readings[reading_count];
+char json_buffer[1024];
+#ifdef WITH_ARDUINOJSON
+char json_document_buffer[1024];
+#endif
+uint8_t binary_buffer[256];
+
+///                     ///
+// Function declarations //
+///                     ///
+
+void generate_reading(uint32_t second, ElectricityReading &reading);
+size_t encode_json_text(const ElectricityReading &reading, char *buffer, size_t buffer_size);
+#ifdef WITH_ARDUINOJSON
+size_t encode_json_document(const ElectricityReading &reading, char *buffer, size_t buffer_size);
+#endif
+size_t encode_binary(const ElectricityReading &reading, uint8_t *buffer);
+template <typename Encode>
+double time_micros_per_point(Encode encode, size_t &total_length);
+bool is_milli_field(uint8_t field);
+
+///                    ///
+// Function definitions //
+///                    ///
+
+int main()
+{
+  for (uint32_t second = 0; second < reading_count; second++)
+    generate_reading(second, readings[second]);
+
+  size_t json_length = 0;
+  size_t binary_length = 0;
+  const double json_micros = time_micros_per_point([](const ElectricityReading &reading)
+                                                   { return encode_json_text(reading, json_buffer, sizeof(json_buffer)); },
+                                                   json_length);
+#ifdef WITH_ARDUINOJSON
+  size_t json_document_length = 0;
+  const double json_document_micros = time_micros_per_point([](const ElectricityReading &reading)
+                                                            { return encode_json_document(reading, json_document_buffer, sizeof(json_document_buffer)); },
+                                                            json_document_length);
+  if (json_document_length == 0)
+  {
+    printf("A json data point did not fit in its StaticJsonDocument<768>\n");
+    return 1;
+  }
+  // Both buffers hold the last reading, the sizes below only apply to the sketch if the texts are the same
+  const size_t last_length = encode_json_text(readings[reading_count - 1], json_buffer, sizeof(json_buffer));
+  if (json_document_length != json_length || last_length != strlen(json_document_buffer) || memcmp(json_buffer, json_document_buffer, last_length) != 0)
+  {
+    printf("The json text differs from the StaticJsonDocument<768> one:\n%.*s\n%s\n", (int)last_length, json_buffer, json_document_buffer);
+    return 1;
+  }
+#endif
+  const double binary_micros = time_micros_per_point([](const ElectricityReading &reading)
+                                                     { return encode_binary(reading, binary_buffer); },
+                                                     binary_length);
+  if (json_length == 0)
+  {
+    printf("A json data point did not fit in its buffer\n");
+    return 1;
+  }
+
+  // Points per batch: "[" + points with "," between + "]" versus the message header + records
+  const double json_point_length = (double)json_length / reading_count;
+  const double binary_point_length = (double)binary_length / reading_count;
+  const size_t json_points_per_batch = (batch_capacity - 2) / (json_point_length + 1);
+  printf("%u electricity data points (with descriptor and trace)\n", reading_count);
+  printf("json (text only):               %6.1f bytes, %6.3f us per point, %3zu points per %zu byte batch\n",
+         json_point_length, json_micros, json_points_per_batch, batch_capacity);
+#ifdef WITH_ARDUINOJSON
+  printf("json (StaticJsonDocument<768>): %6.1f bytes, %6.3f us per point, %3zu points per %zu byte batch\n",
+         json_point_length, json_document_micros, json_points_per_batch, batch_capacity);
+#endif
+  printf("binary (BinaryPoint):           %6.1f bytes, %6.3f us per point, %3zu points per %zu byte batch\n",
+         binary_point_length, binary_micros, (size_t)((batch_capacity - binary_message_header_size) / binary_point_length), batch_capacity);
+  printf("binary is %.1f:1 smaller and %.1fx faster to encode on this host", json_point_length / binary_point_length, json_micros / binary_micros);
+#ifdef WITH_ARDUINOJSON
+  printf(" (%.1fx faster than StaticJsonDocument<768>)", json_document_micros / binary_micros);
+#endif
+  printf("\n");
+  return 0;
+}
+
+// Values drift slowly with some noise, like a household's (the same as the gzip benchmark)
+void generate_reading(uint32_t second, ElectricityReading &reading)
+{
+  using Field = FluviusElectricityField;
+  const uint32_t power_delivered = 400 + (second * 7919) % 1300;
+  const uint32_t power_returned = second % 600 < 200 ? (second * 104729) % 900 : 0;
+
+  reading.unix_time_nsecs = (1700000000ULL + second) * 1000000000ULL;
+  reading.sequence = second + 1;
+  uint32_t *values = reading.values;
+  values[(uint8_t)Field::electricity_switch_position] = 1;
+  values[(uint8_t)Field::electricity_threshold] = 999900;
+  values[(uint8_t)Field::current_max] = 999;
+  values[(uint8_t)Field::electricity_tariff] = 1;
+  values[(uint8_t)Field::energy_delivered_tariff1] = 12345678 + second / 10;
+  values[(uint8_t)Field::energy_delivered_tariff2] = 9876543 + second / 12;
+  values[(uint8_t)Field::energy_returned_tariff1] = 2345678;
+  values[(uint8_t)Field::energy_returned_tariff2] = 1234567 + second / 40;
+  values[(uint8_t)Field::power_delivered] = power_delivered;
+  values[(uint8_t)Field::power_delivered_l1] = power_delivered / 2;
+  values[(uint8_t)Field::power_delivered_l2] = power_delivered / 3;
+  values[(uint8_t)Field::power_delivered_l3] = power_delivered - power_delivered / 2 - power_delivered / 3;
+  values[(uint8_t)Field::power_returned] = power_returned;
+  values[(uint8_t)Field::power_returned_l1] = power_returned;
+  values[(uint8_t)Field::power_returned_l2] = 0;
+  values[(uint8_t)Field::power_returned_l3] = 0;
+  values[(uint8_t)Field::voltage_l1] = 231000 + (second * 31) % 2500;
+  values[(uint8_t)Field::voltage_l2] = 229500 + (second * 17) % 2500;
+  values[(uint8_t)Field::voltage_l3] = 232100 + (second * 13) % 2500;
+  for (uint8_t phase = 0; phase < 3; phase++)
+    values[(uint8_t)Field::current_l1 + phase] = ((power_delivered / 3) * 1000 / 230) / 10 * 10;
+}
+
+#ifdef WITH_ARDUINOJSON
+// Like DsmrSensor::encode_electricity
+size_t encode_json_document(const ElectricityReading &reading, char *buffer, size_t buffer_size)
+{
+  using Field = FluviusElectricityField;
+  char time_buffer[21];
+  char capture_time_buffer[21];
+  char fixed_values[(uint8_t)Field::field_count][milli_value_max_length];
+
+  StaticJsonDocument<768> json;
+  json["bucket"] = "fluvius_smart_meter";
+  json["measurement"] = "fluvius_smart_meter_electricity";
+  snprintf(time_buffer, sizeof(time_buffer), "%llu", (unsigned long long)reading.unix_time_nsecs);
+  json["time"] = (const char *)time_buffer;
+  json["descriptor"] = descriptor_id;
+  JsonObject trace = json.createNestedObject("trace");
+  trace["source"] = trace_source;
+  trace["sequence"] = reading.sequence;
+  snprintf(capture_time_buffer, sizeof(capture_time_buffer), "%llu", (unsigned long long)reading.unix_time_nsecs + 900000000ULL);
+  trace["capture_time"] = (const char *)capture_time_buffer;
+
+  JsonObject fields = json.createNestedObject("fields");
+  for (uint8_t field = 0; field < (uint8_t)Field::field_count; field++)
+  {
+    if (is_milli_field(field))
+      fields[electricity_field_names[field]] = serialized((const char *)fixed_values[field], format_milli_value(reading.values[field], fixed_values[field]));
+    else if (field == (uint8_t)Field::electricity_tariff)
+      fields[electricity_field_names[field]] = "0001";
+    else
+      fields[electricity_field_names[field]] = reading.values[field];
+  }
+  if (json.overflowed())
+    return 0;
+  return serializeJson(json, buffer, buffer_size);
+}
+#endif
+
+// The json text DsmrSensor::encode_electricity sends, appended straight into buffer
+size_t encode_json_text(const ElectricityReading &reading, char *buffer, size_t buffer_size)
+{
+  using Field = FluviusElectricityField;
+  if (buffer_size < 1024)
+    return 0;
+
+  char *position = buffer;
+  auto append = [&position](const char *text)
+  {
+    const size_t length = strlen(text);
+    memcpy(position, text, length);
+    position += length;
+  };
+  auto append_u64 = [&position](uint64_t value)
+  {
+    position += snprintf(position, 21, "%llu", (unsigned long long)value);
+  };
+
+  append(R"({"bucket":"fluvius_smart_meter","measurement":"fluvius_smart_meter_electricity","time":")");
+  append_u64(reading.unix_time_nsecs);
+  append(R"(","descriptor":)");
+  append_u64(descriptor_id);
+  append(R"(,"trace":{"source":")");
+  append(trace_source);
+  append(R"(","sequence":)");
+  append_u64(reading.sequence);
+  append(R"(,"capture_time":")");
+  append_u64(reading.unix_time_nsecs + 900000000ULL);
+  append(R"("},"fields":{)");
+  for (uint8_t field = 0; field < (uint8_t)Field::field_count; field++)
+  {
+    append(field == 0 ? "\"" : ",\"");
+    append(electricity_field_names[field]);
+    append("\":");
+    if (is_milli_field(field))
+      position += format_milli_value(reading.values[field], position);
+    else if (field == (uint8_t)Field::electricity_tariff)
+      append("\"0001\"");
+    else
+      append_u64(reading.values[field]);
+  }
+  append("}}");
+  return position - buffer;
+}
+
+// Like DsmrSensor::encode_electricity_binary
+size_t encode_binary(const ElectricityReading &reading, uint8_t *buffer)
+{
+  using Field = FluviusElectricityField;
+  BinaryPoint<Field> point((uint8_t)BinarySchema::fluvius_electricity);
+  point.set_time(reading.unix_time_nsecs);
+  point.set_descriptor(descriptor_id);
+  point.set_trace(trace_source, reading.sequence, reading.unix_time_nsecs + 900000000ULL);
+  for (uint8_t field = 0; field < (uint8_t)Field::field_count; field++)
+    point.set((Field)field, reading.values[field]);
+  return point.serialize(buffer);
+}
+
+// Encodes every reading iterations times, total_length is the length of one pass over all readings
+template <typename Encode>
+double time_micros_per_point(Encode encode, size_t &total_length)
+{
+  volatile size_t sink = 0; // Keeps the compiler from dropping the work
+  total_length = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+  {
+    for (uint32_t r = 0; r < reading_count; r++)
+    {
+      const size_t length = encode(readings[r]);
+      if (length == 0)
+      {
+        total_length = 0;
+        return 0;
+      }
+      sink = sink + length;
+      if (i == 0)
+        total_length += length;
+    }
+  }
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (iterations * reading_count);
+}
+
+// Every field of FluviusElectricityField is a FixedValue, except these integers
+bool is_milli_field(uint8_t field)
+{
+  using Field = FluviusElectricityField;
+  return field != (uint8_t)Field::electricity_switch_position && field != (uint8_t)Field::current_max &&
+         field != (uint8_t)Field::electricity_tariff;
+}
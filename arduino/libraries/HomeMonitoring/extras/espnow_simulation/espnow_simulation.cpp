@@ -0,0 +1,246 @@
+// Host simulation of many EspNowNodes sending to one EspNowGateway over a lossy radio
+// Checks that every reading is forwarded at most once and reports how many make it, for a given node count and loss rate
+//
+// Build and run (from this folder):
+//   g++ -O2 -std=c++17 -I../../src espnow_simulation.cpp -o espnow_simulation && ./espnow_simulation
+// Arguments (all optional): node count, frame loss in percent, send interval of the nodes in seconds, simulated minutes
+//   ./espnow_simulation 500 10 30 60
+
+///        ///
+// Includes //
+///        ///
+
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "espnow_gateway.h"
+#include "espnow_node.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// A frame in the air, arrives at the gateway at arrival_msecs
+struct Frame
+{
+  uint32_t arrival_msecs;
+  uint8_t mac[6];
+  std::vector<uint8_t> data;
+
+  bool operator>(const Frame &other) const { return arrival_msecs > other.arrival_msecs; }
+};
+
+/*
+ * Frames are lost on the way to the gateway, or their acknowledgement is lost on the way back (the node then retries a reading
+ * the gateway already has). Frames are delayed by a random amount, so frames of different nodes (and retries) get reordered.
+ */
+class SimulatedAir
+{
+public:
+  SimulatedAir(uint32_t seed, uint32_t loss_percent) : random(seed), loss_percent(loss_percent) {}
+
+  // Called by a SimulatedRadio, returns whether the acknowledgement arrived
+  bool transmit(const uint8_t *mac, const uint8_t *data, uint8_t length);
+  // Delivers the frames that arrived by now_msecs to the gateway
+  template <typename Gateway>
+  void deliver(Gateway &gateway, uint32_t now_msecs);
+
+  uint32_t now_msecs = 0;
+  uint32_t frame_count = 0;
+
+private:
+  std::mt19937 random;
+  const uint32_t loss_percent;
+  std::priority_queue<Frame, std::vector<Frame>, std::greater<Frame>> frames;
+};
+
+// One per node, the Radio of EspNowNode
+class SimulatedRadio
+{
+public:
+  SimulatedRadio(SimulatedAir &air, const uint8_t *mac) : air(air), mac(mac) {}
+  bool send(const uint8_t *, const uint8_t *data, uint8_t length) { return air.transmit(mac, data, length); }
+
+private:
+  SimulatedAir &air;
+  const uint8_t *mac;
+};
+
+// What survives deep sleep on a real node
+struct SimulatedNode
+{
+  uint8_t mac[6];
+  uint32_t session;
+  uint32_t sequence;
+  uint32_t next_send_msecs;
+  uint8_t measurement;
+};
+
+///       ///
+// Globals //
+///       ///
+
+constexpr uint16_t max_nodes = 1024;
+constexpr size_t queue_capacity = 64; // Like the electricity_gas_water sketch
+constexpr uint32_t gateway_loop_msecs = 50; // How often the gateway's loop gets to process the queue
+constexpr size_t batch_capacity = 4096;
+
+EspNowGateway<max_nodes, queue_capacity> gateway;
+
+///                     ///
+// Function declarations //
+///                     ///
+
+size_t format_point(const NodeReading &reading, char *buffer, size_t buffer_size);
+
+///                    ///
+// Function definitions //
+///                    ///
+
+int main(int argc, char **argv)
+{
+  const uint32_t node_count = argc > 1 ? atoi(argv[1]) : 300;
+  const uint32_t loss_percent = argc > 2 ? atoi(argv[2]) : 10;
+  const uint32_t send_interval_msecs = (argc > 3 ? atoi(argv[3]) : 30) * 1000;
+  const uint32_t duration_msecs = (argc > 4 ? atoi(argv[4]) : 60) * 60 * 1000;
+
+  SimulatedAir air(1234, loss_percent);
+  std::mt19937 random(5678);
+
+  std::vector<SimulatedNode> nodes(node_count);
+  for (uint32_t i = 0; i < node_count; i++)
+  {
+    const uint8_t mac[6] = {0x24, 0x0a, 0xc4, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+    memcpy(nodes[i].mac, mac, sizeof(mac));
+    nodes[i].session = random() | 1;
+    nodes[i].sequence = 0;
+    nodes[i].next_send_msecs = random() % send_interval_msecs; // Nodes don't wake up in step
+    nodes[i].measurement = i % 2;
+  }
+
+  std::set<std::tuple<uint32_t, uint32_t, uint32_t>> sent_readings;      // node, session, sequence
+  std::set<std::tuple<uint32_t, uint32_t, uint32_t>> forwarded_readings;
+  uint32_t reboot_count = 0;
+  uint32_t point_count = 0;
+  uint32_t batch_count = 0;
+  size_t batch_size = 0;
+  size_t total_bytes = 0;
+  bool has_duplicate = false;
+
+  for (uint32_t now_msecs = 0; now_msecs < duration_msecs; now_msecs++)
+  {
+    air.now_msecs = now_msecs;
+    for (uint32_t i = 0; i < node_count; i++)
+    {
+      SimulatedNode &node = nodes[i];
+      if (now_msecs < node.next_send_msecs)
+        continue;
+
+      // Now and then a node loses power instead of going to deep sleep, it then starts a new session
+      if (random() % 1000 == 0)
+      {
+        node.session = random() | 1;
+        node.sequence = 0;
+        reboot_count++;
+      }
+
+      SimulatedRadio radio(air, node.mac);
+      EspNowNode<SimulatedRadio> espnow_node(radio, node.mac, node.session, node.sequence);
+      const int32_t milli_values[2] = {(int32_t)(random() % 5000), (int32_t)(random() % 100000)};
+      espnow_node.send_reading(node.measurement, milli_values, node.measurement + 1);
+      sent_readings.insert({i, node.session, node.sequence});
+      node.next_send_msecs = now_msecs + send_interval_msecs;
+    }
+
+    air.deliver(gateway, now_msecs);
+
+    if (now_msecs % gateway_loop_msecs != 0)
+      continue;
+    gateway.process([&](const NodeReading &reading) {
+      const uint32_t node_index = (reading.mac[3] << 16) | (reading.mac[4] << 8) | reading.mac[5];
+      if (!forwarded_readings.insert({node_index, reading.packet.session, reading.packet.sequence}).second)
+        has_duplicate = true;
+
+      // Batched like PointBatch
+      char point[256];
+      const size_t point_size = format_point(reading, point, sizeof(point));
+      if (batch_size > 0 && batch_size + 1 + point_size + 1 > batch_capacity)
+      {
+        total_bytes += batch_size + 1;
+        batch_count++;
+        batch_size = 0;
+      }
+      batch_size += 1 + point_size;
+      point_count++;
+    });
+  }
+  if (batch_size > 0)
+  {
+    total_bytes += batch_size + 1;
+    batch_count++;
+  }
+
+  const EspNowGatewayStats stats = gateway.get_stats();
+  printf("%u nodes, %u%% frame loss, a reading every %u s, %u minutes\n", node_count, loss_percent, send_interval_msecs / 1000, duration_msecs / 60000);
+  printf("Readings sent:   %zu (%u node reboots)\n", sent_readings.size(), reboot_count);
+  printf("Frames sent:     %u (including retries)\n", air.frame_count);
+  printf("Gateway:         %u received, %u invalid, %u queue overflows, %u duplicates, %u unknown nodes, %u nodes\n",
+         stats.received, stats.invalid, stats.queue_overflows, stats.duplicates, stats.unknown_nodes, stats.node_count);
+  printf("Forwarded:       %u readings (%.2f%% of sent), %u points in %u batches, %zu bytes\n",
+         stats.forwarded, 100.0 * stats.forwarded / sent_readings.size(), point_count, batch_count, total_bytes);
+  if (has_duplicate)
+  {
+    printf("A reading was forwarded more than once\n");
+    return 1;
+  }
+  printf("No reading was forwarded more than once\n");
+  return 0;
+}
+
+bool SimulatedAir::transmit(const uint8_t *mac, const uint8_t *data, uint8_t length)
+{
+  frame_count++;
+  if (random() % 100 < loss_percent)
+    return false; // Lost on the way to the gateway
+
+  Frame frame;
+  frame.arrival_msecs = now_msecs + random() % 20;
+  memcpy(frame.mac, mac, sizeof(frame.mac));
+  frame.data.assign(data, data + length);
+  frames.push(frame);
+
+  return random() % 100 >= loss_percent; // The acknowledgement can get lost too
+}
+
+template <typename Gateway>
+void SimulatedAir::deliver(Gateway &gateway, uint32_t now_msecs)
+{
+  while (!frames.empty() && frames.top().arrival_msecs <= now_msecs)
+  {
+    const Frame &frame = frames.top();
+    gateway.on_receive(frame.mac, frame.data.data(), frame.data.size(), frame.arrival_msecs);
+    frames.pop();
+  }
+}
+
+// Like EspNowGatewaySensor::encode in the electricity_gas_water sketch
+size_t format_point(const NodeReading &reading, char *buffer, size_t buffer_size)
+{
+  static const char *field_names[2][2] = {{"depth_in_meters"}, {"temperature", "humidity"}};
+  int length = snprintf(buffer, buffer_size, R"({"bucket":"default","measurement":"node_%u","time":"%u000000","tags":{"node":"%02x%02x%02x%02x%02x%02x"},"fields":{)",
+                        reading.packet.measurement, reading.receive_timestamp_msecs,
+                        reading.mac[0], reading.mac[1], reading.mac[2], reading.mac[3], reading.mac[4], reading.mac[5]);
+  for (uint8_t i = 0; i < reading.packet.value_count; i++)
+  {
+    const int32_t milli_value = reading.packet.milli_values[i];
+    length += snprintf(buffer + length, buffer_size - length, R"(%s"%s":%d.%03d)", i == 0 ? "" : ",",
+                       field_names[reading.packet.measurement][i], milli_value / 1000, abs(milli_value % 1000));
+  }
+  length += snprintf(buffer + length, buffer_size - length, "}}");
+  return length;
+}
@@ -0,0 +1,152 @@
+// Host benchmark of format_milli_value: time per FixedValue field and exactness, versus the float path of the
+// former fixed_value_to_json_float macro (serialized(String(fixed_value.val(), 3))), on generated electricity readings
+//
+// Build and run (from this folder):
+//   g++ -O2 -std=c++17 -I../../src fixed_decimal_benchmark.cpp -o fixed_decimal_benchmark && ./fixed_decimal_benchmark
+// Both paths stop at the text: handing it to the json document costs about the same for either
+// (FixedValueJsonFormatter of the sketch only adds a bounds check around format_milli_value).
+
+///        ///
+// Includes //
+///        ///
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "fixed_decimal.h"
+
+///         ///
+// Constants //
+///         ///
+
+constexpr uint32_t reading_count = 1000;
+constexpr uint32_t fields_per_reading = 19; // The FixedValue fields of an electricity data point
+constexpr uint32_t iterations = 200;
+constexpr uint32_t counter_sweep_max = 100000000; // Energy counters up to 100000 kWh, as milli-units
+constexpr uint32_t counter_sweep_step = 997;
+
+///       ///
+// Globals //
+///       ///
+
+uint32_t milli_values[reading_count * fields_per_reading]; // FixedValue::_value, as parsed from the telegram
+char text_buffer[milli_value_max_length + 1];
+
+///                     ///
+// Function declarations //
+///                     ///
+
+void generate_reading(uint32_t second, uint32_t *values);
+size_t format_float(uint32_t milli_value, char *buffer);
+bool is_float_exact(uint32_t milli_value);
+template <typename Format>
+double time_nanos_per_field(Format format);
+
+///                    ///
+// Function definitions //
+///                    ///
+
+int main()
+{
+  for (uint32_t second = 0; second < reading_count; second++)
+    generate_reading(second, milli_values + second * fields_per_reading);
+
+  uint32_t float_mismatches = 0;
+  for (uint32_t value : milli_values)
+    float_mismatches += !is_float_exact(value);
+  uint32_t counter_count = 0;
+  uint32_t counter_mismatches = 0;
+  uint32_t first_counter_mismatch = 0;
+  for (uint32_t value = 0; value < counter_sweep_max; value += counter_sweep_step)
+  {
+    counter_count++;
+    if (!is_float_exact(value))
+    {
+      if (counter_mismatches++ == 0)
+        first_counter_mismatch = value;
+    }
+  }
+
+  const double integer_nanos = time_nanos_per_field([](uint32_t value)
+                                                    { return format_milli_value(value, text_buffer); });
+  const double float_nanos = time_nanos_per_field([](uint32_t value)
+                                                  { return format_float(value, text_buffer); });
+
+  const uint32_t field_count = reading_count * fields_per_reading;
+  printf("%u FixedValue fields (%u electricity data points)\n", field_count, reading_count);
+  printf("format_milli_value:           %6.1f ns per field, exact\n", integer_nanos);
+  printf("String(fixed_value.val(), 3): %6.1f ns per field, %u fields (%.1f%%) not exact\n",
+         float_nanos, float_mismatches, 100.0 * float_mismatches / field_count);
+  printf("format_milli_value is %.1fx faster on this host\n", float_nanos / integer_nanos);
+  printf("Energy counters up to %u kWh: %u of %u (%.1f%%) not exact through float",
+         counter_sweep_max / 1000, counter_mismatches, counter_count, 100.0 * counter_mismatches / counter_count);
+  if (counter_mismatches > 0)
+  {
+    format_float(first_counter_mismatch, text_buffer);
+    printf(", the first from %u.%03u kWh (%s)", first_counter_mismatch / 1000, first_counter_mismatch % 1000, text_buffer);
+  }
+  printf("\n");
+  return 0;
+}
+
+// The FixedValue fields of encode_electricity, with the values of the gzip benchmark
+void generate_reading(uint32_t second, uint32_t *values)
+{
+  const uint32_t power_delivered = 400 + (second * 7919) % 1300;
+  const uint32_t power_returned = second % 600 < 200 ? (second * 104729) % 900 : 0;
+
+  *values++ = 999900;                 // electricity_threshold
+  *values++ = 12345678 + second / 10; // energy_delivered_tariff1
+  *values++ = 9876543 + second / 12;  // energy_delivered_tariff2
+  *values++ = 2345678;                // energy_returned_tariff1
+  *values++ = 1234567 + second / 40;  // energy_returned_tariff2
+  *values++ = power_delivered;
+  *values++ = power_delivered / 2;
+  *values++ = power_delivered / 3;
+  *values++ = power_delivered - power_delivered / 2 - power_delivered / 3;
+  *values++ = power_returned;
+  *values++ = power_returned;
+  *values++ = 0;
+  *values++ = 0;
+  *values++ = 231000 + (second * 31) % 2500; // voltage_l1..3
+  *values++ = 229500 + (second * 17) % 2500;
+  *values++ = 232100 + (second * 13) % 2500;
+  for (uint8_t phase = 0; phase < 3; phase++) // current_l1..3
+    *values++ = ((power_delivered / 3) * 1000 / 230) / 10 * 10;
+}
+
+// Like String(fixed_value.val(), 3): FixedValue::val() divides as float, String formats it into a heap allocation
+size_t format_float(uint32_t milli_value, char *buffer)
+{
+  const float value = milli_value / 1000.0f;
+  char digits[33];
+  const int length = snprintf(digits, sizeof(digits), "%.3f", value);
+  char *heap_text = (char *)malloc(length + 1);
+  memcpy(heap_text, digits, length + 1);
+  memcpy(buffer, heap_text, length + 1); // What serialized() then copies into the json document
+  free(heap_text);
+  return length;
+}
+
+// Whether the float path writes the same text as the integer's own digits
+bool is_float_exact(uint32_t milli_value)
+{
+  char exact[milli_value_max_length + 1];
+  exact[format_milli_value(milli_value, exact)] = '\0';
+  format_float(milli_value, text_buffer);
+  return strcmp(exact, text_buffer) == 0;
+}
+
+// Formats every field iterations times
+template <typename Format>
+double time_nanos_per_field(Format format)
+{
+  volatile size_t sink = 0; // Keeps the compiler from dropping the work
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++)
+    for (uint32_t value : milli_values)
+      sink = sink + format(value);
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (iterations * reading_count * fields_per_reading);
+}
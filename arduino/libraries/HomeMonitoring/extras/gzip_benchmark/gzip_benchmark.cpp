@@ -0,0 +1,195 @@
+// Host benchmark of GzipCompressor: cpu time versus bytes saved, on batches like the electricity_gas_water sketch sends
+//
+// Build and run (from this folder):
+//   g++ -O2 -std=c++17 -I../../src gzip_benchmark.cpp -o gzip_benchmark && ./gzip_benchmark
+// Also compare with zlib (and check that zlib can decompress every result):
+//   g++ -O2 -std=c++17 -DWITH_ZLIB -I../../src gzip_benchmark.cpp -lz -o gzip_benchmark && ./gzip_benchmark
+// Batches captured from the collector's log (one message per file) can be passed as arguments instead:
+//   ./gzip_benchmark batch1.json batch2.json ...
+
+///        ///
+// Includes //
+///        ///
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "gzip_compressor.h"
+
+///       ///
+// Globals //
+///       ///
+
+constexpr size_t batch_capacity = 4096; // upload_batch_capacity in the electricity_gas_water settings.h.example
+constexpr uint32_t iterations = 2000;
+
+GzipCompressor<batch_capacity> compressor;
+
+///                     ///
+// Function declarations //
+///                     ///
+
+std::vector<std::string> generate_batches(uint32_t batch_count);
+std::string generate_electricity_point(uint32_t second);
+std::string format_milli_value(int32_t milli_value);
+#ifdef WITH_ZLIB
+size_t zlib_compress(const std::string &input, int level, std::vector<uint8_t> &output);
+bool zlib_check(const uint8_t *compressed, size_t compressed_length, const std::string &expected);
+#endif
+
+///                    ///
+// Function definitions //
+///                    ///
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> batches;
+  for (int i = 1; i < argc; i++)
+  {
+    std::ifstream file(argv[i], std::ios::binary);
+    batches.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  if (batches.empty())
+    batches = generate_batches(20);
+
+  size_t total_input = 0;
+  size_t total_output = 0;
+  double total_micros = 0;
+#ifdef WITH_ZLIB
+  size_t total_zlib_fast_output = 0;
+  size_t total_zlib_default_output = 0;
+#endif
+  for (const std::string &batch : batches)
+  {
+    if (batch.size() > batch_capacity)
+    {
+      printf("Skipping a batch of %zu bytes, larger than the batch capacity\n", batch.size());
+      continue;
+    }
+
+    size_t output_length = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+      output_length = compressor.compress(batch.data(), batch.size());
+    const double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    total_input += batch.size();
+    total_output += output_length > 0 ? output_length : batch.size(); // Sent as-is if it doesn't get smaller
+    total_micros += micros;
+
+#ifdef WITH_ZLIB
+    if (output_length > 0 && !zlib_check(compressor.get_output(), output_length, batch))
+    {
+      printf("zlib could not decompress the result of a batch correctly\n");
+      return 1;
+    }
+    std::vector<uint8_t> zlib_output;
+    total_zlib_fast_output += zlib_compress(batch, 1, zlib_output);
+    total_zlib_default_output += zlib_compress(batch, Z_DEFAULT_COMPRESSION, zlib_output);
+#endif
+  }
+
+  printf("%zu batches, %zu bytes\n", batches.size(), total_input);
+  printf("GzipCompressor: %zu bytes (%.1f:1, %.1f%% saved), %.1f us per batch, %.1f MB/s on this host\n",
+         total_output, (double)total_input / total_output, 100.0 * (total_input - total_output) / total_input,
+         total_micros / batches.size(), total_input / total_micros);
+#ifdef WITH_ZLIB
+  printf("zlib level 1:   %zu bytes (%.1f:1)\n", total_zlib_fast_output, (double)total_input / total_zlib_fast_output);
+  printf("zlib level 6:   %zu bytes (%.1f:1)\n", total_zlib_default_output, (double)total_input / total_zlib_default_output);
+  printf("zlib decompressed every GzipCompressor result correctly\n");
+#endif
+  return 0;
+}
+
+// One telegram per second, with a gas reading every 5 minutes, cut into batches like PointBatch does
+std::vector<std::string> generate_batches(uint32_t batch_count)
+{
+  std::vector<std::string> batches;
+  std::string batch;
+  for (uint32_t second = 0; batches.size() < batch_count; second++)
+  {
+    std::string point = generate_electricity_point(second);
+    if (second % 300 == 0)
+      point += R"(,{"bucket":"fluvius_smart_meter","measurement":"fluvius_smart_meter_gas","time":")" + std::to_string(1700000000ULL + second) + R"(000000000","descriptor":2746109513,"fields":{"gas_device_type":"3","gas_valve_position":0,"gas_m3":)" + format_milli_value(4321987 + second / 30) + "}}";
+
+    if (!batch.empty() && batch.size() + 1 + point.size() + 1 > batch_capacity)
+    {
+      batches.push_back(batch + "]");
+      batch.clear();
+    }
+    batch += batch.empty() ? "[" : ",";
+    batch += point;
+  }
+  return batches;
+}
+
+// Values drift slowly with some noise, like a household's
+std::string generate_electricity_point(uint32_t second)
+{
+  const int32_t power_delivered = 400 + (second * 7919) % 1300;
+  const int32_t power_returned = second % 600 < 200 ? (second * 104729) % 900 : 0;
+  const int32_t voltages[3] = {231000 + (int32_t)(second * 31) % 2500, 229500 + (int32_t)(second * 17) % 2500, 232100 + (int32_t)(second * 13) % 2500};
+
+  std::string point = R"({"bucket":"fluvius_smart_meter","measurement":"fluvius_smart_meter_electricity","time":")" + std::to_string(1700000000ULL + second) + R"(000000000","descriptor":3127840517,"fields":{)";
+  point += R"("electricity_switch_position":1,"electricity_threshold":999.9,"current_max":999,"electricity_tariff":"0001",)";
+  point += R"("energy_delivered_tariff1":)" + format_milli_value(12345678 + second / 10) + R"(,"energy_delivered_tariff2":)" + format_milli_value(9876543 + second / 12);
+  point += R"(,"energy_returned_tariff1":)" + format_milli_value(2345678) + R"(,"energy_returned_tariff2":)" + format_milli_value(1234567 + second / 40);
+  point += R"(,"power_delivered":)" + format_milli_value(power_delivered);
+  point += R"(,"power_delivered_l1":)" + format_milli_value(power_delivered / 2) + R"(,"power_delivered_l2":)" + format_milli_value(power_delivered / 3);
+  point += R"(,"power_delivered_l3":)" + format_milli_value(power_delivered - power_delivered / 2 - power_delivered / 3);
+  point += R"(,"power_returned":)" + format_milli_value(power_returned) + R"(,"power_returned_l1":)" + format_milli_value(power_returned);
+  point += R"(,"power_returned_l2":0.000,"power_returned_l3":0.000)";
+  for (int i = 0; i < 3; i++)
+    point += R"(,"voltage_l)" + std::to_string(i + 1) + R"(":)" + format_milli_value(voltages[i]);
+  for (int i = 0; i < 3; i++)
+    point += R"(,"current_l)" + std::to_string(i + 1) + R"(":)" + format_milli_value(((power_delivered / 3) * 1000 / 230) / 10 * 10);
+  point += "}}";
+  return point;
+}
+
+// Like format_milli_value of fixed_decimal.h
+std::string format_milli_value(int32_t milli_value)
+{
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%d.%03d", milli_value / 1000, milli_value % 1000);
+  return buffer;
+}
+
+#ifdef WITH_ZLIB
+size_t zlib_compress(const std::string &input, int level, std::vector<uint8_t> &output)
+{
+  z_stream stream = {};
+  deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY); // + 16 = gzip
+  output.resize(deflateBound(&stream, input.size()));
+  stream.next_in = (Bytef *)input.data();
+  stream.avail_in = input.size();
+  stream.next_out = output.data();
+  stream.avail_out = output.size();
+  deflate(&stream, Z_FINISH);
+  const size_t output_length = stream.total_out;
+  deflateEnd(&stream);
+  return output_length;
+}
+
+bool zlib_check(const uint8_t *compressed, size_t compressed_length, const std::string &expected)
+{
+  std::vector<uint8_t> output(expected.size() + 1);
+  z_stream stream = {};
+  inflateInit2(&stream, 15 + 16);
+  stream.next_in = (Bytef *)compressed;
+  stream.avail_in = compressed_length;
+  stream.next_out = output.data();
+  stream.avail_out = output.size();
+  const int result = inflate(&stream, Z_FINISH);
+  const size_t output_length = stream.total_out;
+  inflateEnd(&stream);
+  return result == Z_STREAM_END && output_length == expected.size() && memcmp(output.data(), expected.data(), expected.size()) == 0;
+}
+#endif
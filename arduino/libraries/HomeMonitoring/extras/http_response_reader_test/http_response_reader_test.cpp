@@ -0,0 +1,205 @@
+// Host test of HttpResponseReader: responses of the collector as they arrive on a keep-alive connection
+// (pipelined, cut at any byte, with bodies), the Retry-After it reports and the outcome of every request
+//
+// Build and run (from this folder):
+//   g++ -O2 -std=c++17 -I../../src http_response_reader_test.cpp -o http_response_reader_test && ./http_response_reader_test
+
+///        ///
+// Includes //
+///        ///
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include "http_response_reader.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Hands out its data in reads of at most chunk_size bytes, like a WiFiClient with data still in flight
+struct FakeSocket
+{
+  std::string data;
+  size_t chunk_size = SIZE_MAX;
+  size_t position = 0;
+
+  int available() { return std::min(data.size() - position, chunk_size); }
+  int read(uint8_t *buffer, size_t size)
+  {
+    const size_t length = std::min({size, data.size() - position, chunk_size});
+    data.copy((char *)buffer, length, position);
+    position += length;
+    return length;
+  }
+};
+
+///         ///
+// Constants //
+///         ///
+
+// As the collector answers (werkzeug), with a reason phrase and headers the reader doesn't look at
+const char *const accepted_response = "HTTP/1.1 204 NO CONTENT\r\nServer: Werkzeug/3.0.1 Python/3.11.4\r\nDate: Sat, 18 Nov 2023 12:00:00 GMT\r\n\r\n";
+const char *const throttled_response = "HTTP/1.1 204 NO CONTENT\r\nRetry-After: 30\r\nConnection: keep-alive\r\n\r\n";
+const char *const rejected_response = "HTTP/1.1 429 TOO MANY REQUESTS\r\nretry-after:  30\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: 23\r\n\r\nToo many requests, wait";
+const char *const capped_response = "HTTP/1.1 204 NO CONTENT\r\nRetry-After: 86400\r\n\r\n";
+
+///       ///
+// Globals //
+///       ///
+
+uint32_t failures = 0;
+
+///                     ///
+// Function declarations //
+///                     ///
+
+void check(bool condition, const char *description);
+void feed(HttpResponseReader &reader, const std::string &data, size_t chunk_size = SIZE_MAX);
+void send_requests(HttpResponseReader &reader, uint32_t count);
+void test_pipelined_responses();
+void test_cut_responses();
+void test_retry_after();
+void test_request_outcomes();
+
+///                    ///
+// Function definitions //
+///                    ///
+
+int main()
+{
+  test_pipelined_responses();
+  test_cut_responses();
+  test_retry_after();
+  test_request_outcomes();
+
+  if (failures > 0)
+  {
+    printf("%u checks failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
+
+void check(bool condition, const char *description)
+{
+  if (condition)
+    return;
+  printf("Failed: %s\n", description);
+  failures++;
+}
+
+void feed(HttpResponseReader &reader, const std::string &data, size_t chunk_size)
+{
+  FakeSocket socket{data, chunk_size};
+  reader.read_available(socket);
+}
+
+void send_requests(HttpResponseReader &reader, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++)
+    reader.count_request();
+}
+
+// Several responses in one read, a body between them
+void test_pipelined_responses()
+{
+  HttpResponseReader reader;
+  send_requests(reader, 4);
+  feed(reader, std::string(accepted_response) + rejected_response + throttled_response + accepted_response);
+
+  const HttpResponseStats &stats = reader.get_stats();
+  check(stats.responses == 4, "pipelined: every response is counted");
+  check(stats.throttled_responses == 2, "pipelined: both responses with Retry-After are counted");
+  check(stats.rejected_messages == 1, "pipelined: the 429 is counted as rejected");
+  check(reader.get_retry_after_msecs() == 0, "pipelined: the last response had no Retry-After");
+}
+
+// The same responses cut at every possible chunk size, down to a byte at a time
+void test_cut_responses()
+{
+  const std::string responses = std::string(rejected_response) + throttled_response;
+  for (size_t chunk_size = 1; chunk_size <= responses.size(); chunk_size++)
+  {
+    HttpResponseReader reader;
+    send_requests(reader, 2);
+    feed(reader, responses, chunk_size);
+    if (reader.get_stats().responses != 2 || reader.get_stats().rejected_messages != 1 || reader.get_retry_after_msecs() != 30000)
+    {
+      printf("With reads of %zu bytes:\n", chunk_size);
+      check(false, "cut: the responses read the same in any chunk size");
+      return;
+    }
+  }
+
+  // A response that is only partly there is finished by a later read
+  HttpResponseReader reader;
+  send_requests(reader, 1);
+  const std::string response = rejected_response;
+  const size_t half = response.size() / 2;
+  feed(reader, response.substr(0, half));
+  check(reader.get_stats().responses == 0, "partial: half a response is not counted yet");
+  check(reader.get_request_outcome(1) == RequestOutcome::pending, "partial: its request is still pending");
+  feed(reader, response.substr(half));
+  check(reader.get_stats().responses == 1, "partial: the rest finishes it");
+  check(reader.get_request_outcome(1) == RequestOutcome::rejected, "partial: its request was rejected");
+}
+
+void test_retry_after()
+{
+  HttpResponseReader reader;
+  send_requests(reader, 4);
+  feed(reader, throttled_response);
+  check(reader.get_retry_after_msecs() == 30000, "retry-after: taken from the response");
+  feed(reader, capped_response);
+  check(reader.get_retry_after_msecs() == HttpResponseReader::max_retry_after_secs * 1000, "retry-after: capped");
+
+  // A connection that closes halfway through a response doesn't end the slowdown
+  feed(reader, std::string(accepted_response).substr(0, 20));
+  reader.reset();
+  check(reader.get_retry_after_msecs() == HttpResponseReader::max_retry_after_secs * 1000, "retry-after: holds after a reset");
+  check(reader.get_stats().responses == 2, "retry-after: the cut off response is not counted");
+
+  // The next whole response without it does
+  feed(reader, accepted_response);
+  check(reader.get_retry_after_msecs() == 0, "retry-after: a response without it ends the slowdown");
+}
+
+void test_request_outcomes()
+{
+  HttpResponseReader reader;
+  check(reader.get_sent_request_count() == 0, "outcomes: no requests yet");
+  send_requests(reader, 3);
+  check(reader.get_sent_request_count() == 3, "outcomes: requests are numbered from 1");
+  feed(reader, std::string(accepted_response) + rejected_response);
+  check(reader.get_request_outcome(1) == RequestOutcome::accepted, "outcomes: the first request was accepted");
+  check(reader.get_request_outcome(2) == RequestOutcome::rejected, "outcomes: the second request was rejected");
+  check(reader.get_request_outcome(3) == RequestOutcome::pending, "outcomes: the third request is pending");
+
+  // The connection closes before the third response arrives
+  reader.reset();
+  check(reader.get_request_outcome(2) == RequestOutcome::rejected, "outcomes: answered requests keep their outcome");
+  check(reader.get_request_outcome(3) == RequestOutcome::unanswered, "outcomes: the pending request lost its response");
+
+  // Requests on the next connection are matched to their own responses
+  send_requests(reader, 2);
+  feed(reader, std::string(rejected_response) + accepted_response);
+  check(reader.get_request_outcome(4) == RequestOutcome::rejected, "outcomes: after a reset the next response is the next request's");
+  check(reader.get_request_outcome(5) == RequestOutcome::accepted, "outcomes: and so on");
+
+  // A response nobody asked for is not matched to a request
+  feed(reader, rejected_response);
+  send_requests(reader, 1);
+  check(reader.get_request_outcome(6) == RequestOutcome::pending, "outcomes: an unasked response doesn't answer a later request");
+
+  // Only the outcomes of the last 32 requests are kept
+  feed(reader, accepted_response);
+  send_requests(reader, 32);
+  for (uint32_t i = 0; i < 32; i++)
+    feed(reader, rejected_response);
+  check(reader.get_request_outcome(6) == RequestOutcome::unanswered, "outcomes: too old to tell");
+  check(reader.get_request_outcome(7) == RequestOutcome::rejected, "outcomes: the oldest one kept");
+  check(reader.get_request_outcome(38) == RequestOutcome::rejected, "outcomes: the newest one");
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+///         ///
+// Constants //
+///         ///
+
+/*
+ * Binary messages to the collector, an alternative to json arrays of data points. All numbers are little-endian.
+ *   Message: "HMB", binary_message_version, then records until the end of the message
+ *   Json record: binary_json_record, uint16 length, a json data point or descriptor registration (like in json messages)
+ *   Point record: binary_point_record, uint8 schema id, uint8 flags, uint32 bitmap of the fields present,
+ *                 [uint64 time] [uint32 descriptor] [uint8 source length, source, uint32 sequence [uint64 capture time]],
+ *                 uint32 value of every field present, in field id order
+ * A schema (see binary_schemas.h) fixes the bucket, measurement, and name and type of every field id, the collector holds the same table.
+ */
+static constexpr uint8_t binary_message_magic[3] = {'H', 'M', 'B'};
+static constexpr uint8_t binary_message_version = 1;
+static constexpr size_t binary_message_header_size = 4;
+
+static constexpr uint8_t binary_json_record = 1;
+static constexpr uint8_t binary_point_record = 2;
+static constexpr size_t binary_json_record_header_size = 3;
+
+static constexpr uint8_t binary_point_has_time = 1 << 0;
+static constexpr uint8_t binary_point_has_descriptor = 1 << 1;
+static constexpr uint8_t binary_point_has_trace = 1 << 2;
+static constexpr uint8_t binary_point_has_trace_capture_time = 1 << 3;
+
+///                    ///
+// Function definitions //
+///                    ///
+
+void write_binary_message_header(uint8_t *buffer)
+{
+  memcpy(buffer, binary_message_magic, sizeof(binary_message_magic));
+  buffer[3] = binary_message_version;
+}
+
+void write_binary_json_record_header(uint8_t *buffer, uint16_t json_length)
+{
+  buffer[0] = binary_json_record;
+  buffer[1] = json_length & 0xff;
+  buffer[2] = json_length >> 8;
+}
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * A data point as a binary point record: values are raw unsigned integers (milli-units for decimal values, like FixedValue),
+ * set by field id, so nothing is formatted or named on the device.
+ * Field is the field id enum of a schema (see binary_schemas.h), it must end with field_count (at most 32).
+ * Added to a batch with PointBatch::add_binary(...).
+ */
+template <typename Field>
+class BinaryPoint
+{
+public:
+  static constexpr uint8_t field_count = (uint8_t)Field::field_count;
+  static_assert(field_count <= 32, "The field bitmap holds 32 fields");
+
+  explicit BinaryPoint(uint8_t schema_id) : schema_id(schema_id) {}
+
+  void set(Field field, uint32_t value);
+  void set_time(uint64_t unix_time_nsecs);
+  void set_descriptor(uint32_t descriptor_id);
+  // source must outlive the point, capture_unix_time_nsecs 0 = unknown
+  void set_trace(const char *source, uint32_t sequence, uint64_t capture_unix_time_nsecs);
+
+  size_t measure() const;
+  // Writes the point record, buffer must hold measure() bytes
+  size_t serialize(uint8_t *buffer) const;
+
+private:
+  static uint8_t *write_u32(uint8_t *buffer, uint32_t value);
+  static uint8_t *write_u64(uint8_t *buffer, uint64_t value);
+
+private:
+  const uint8_t schema_id;
+  uint8_t flags = 0;
+  uint32_t field_bitmap = 0;
+  uint32_t values[field_count];
+  uint64_t unix_time_nsecs = 0;
+  uint32_t descriptor_id = 0;
+  const char *trace_source = nullptr;
+  uint8_t trace_source_length = 0;
+  uint32_t trace_sequence = 0;
+  uint64_t trace_capture_unix_time_nsecs = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Field>
+void BinaryPoint<Field>::set(Field field, uint32_t value)
+{
+  const uint8_t index = (uint8_t)field;
+  values[index] = value;
+  field_bitmap |= (uint32_t)1 << index;
+}
+
+template <typename Field>
+void BinaryPoint<Field>::set_time(uint64_t unix_time_nsecs)
+{
+  this->unix_time_nsecs = unix_time_nsecs;
+  flags |= binary_point_has_time;
+}
+
+template <typename Field>
+void BinaryPoint<Field>::set_descriptor(uint32_t descriptor_id)
+{
+  this->descriptor_id = descriptor_id;
+  flags |= binary_point_has_descriptor;
+}
+
+template <typename Field>
+void BinaryPoint<Field>::set_trace(const char *source, uint32_t sequence, uint64_t capture_unix_time_nsecs)
+{
+  const size_t source_length = strlen(source);
+  trace_source = source;
+  trace_source_length = source_length < 255 ? source_length : 255;
+  trace_sequence = sequence;
+  trace_capture_unix_time_nsecs = capture_unix_time_nsecs;
+  flags |= binary_point_has_trace;
+  if (capture_unix_time_nsecs != 0)
+    flags |= binary_point_has_trace_capture_time;
+}
+
+template <typename Field>
+size_t BinaryPoint<Field>::measure() const
+{
+  size_t length = 1 + 1 + 1 + 4; // Record type, schema id, flags, field bitmap
+  if (flags & binary_point_has_time)
+    length += 8;
+  if (flags & binary_point_has_descriptor)
+    length += 4;
+  if (flags & binary_point_has_trace)
+    length += 1 + trace_source_length + 4;
+  if (flags & binary_point_has_trace_capture_time)
+    length += 8;
+  return length + 4 * __builtin_popcount(field_bitmap);
+}
+
+template <typename Field>
+size_t BinaryPoint<Field>::serialize(uint8_t *buffer) const
+{
+  uint8_t *position = buffer;
+  *position++ = binary_point_record;
+  *position++ = schema_id;
+  *position++ = flags;
+  position = write_u32(position, field_bitmap);
+  if (flags & binary_point_has_time)
+    position = write_u64(position, unix_time_nsecs);
+  if (flags & binary_point_has_descriptor)
+    position = write_u32(position, descriptor_id);
+  if (flags & binary_point_has_trace)
+  {
+    *position++ = trace_source_length;
+    memcpy(position, trace_source, trace_source_length);
+    position += trace_source_length;
+    position = write_u32(position, trace_sequence);
+  }
+  if (flags & binary_point_has_trace_capture_time)
+    position = write_u64(position, trace_capture_unix_time_nsecs);
+
+  for (uint8_t index = 0; index < field_count; index++)
+    if (field_bitmap & ((uint32_t)1 << index))
+      position = write_u32(position, values[index]);
+  return position - buffer;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+template <typename Field>
+uint8_t *BinaryPoint<Field>::write_u32(uint8_t *buffer, uint32_t value)
+{
+  for (uint8_t i = 0; i < 4; i++)
+    *buffer++ = value >> (8 * i);
+  return buffer;
+}
+
+template <typename Field>
+uint8_t *BinaryPoint<Field>::write_u64(uint8_t *buffer, uint64_t value)
+{
+  for (uint8_t i = 0; i < 8; i++)
+    *buffer++ = value >> (8 * i);
+  return buffer;
+}
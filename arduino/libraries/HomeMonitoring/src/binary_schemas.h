@@ -0,0 +1,59 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stdint.h>
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+/*
+ * Schemas of binary point records (see binary_point.h).
+ * The collector's BINARY_SCHEMAS table holds the same ids, fields and field order (external_collector.py):
+ * only ever append fields and schemas, never reorder, renumber or reuse them, devices and collector are updated separately.
+ */
+enum class BinarySchema : uint8_t
+{
+  fluvius_electricity = 1,
+  fluvius_gas = 2,
+};
+
+// The fluvius_smart_meter_electricity measurement of the electricity_gas_water sketch
+enum class FluviusElectricityField : uint8_t
+{
+  electricity_switch_position, // Integer
+  electricity_threshold,       // Milli-units
+  current_max,                 // Integer
+  electricity_tariff,          // Integer, stored as a 4-digit string ("0001")
+  energy_delivered_tariff1,    // Milli-units (from here on)
+  energy_delivered_tariff2,
+  energy_returned_tariff1,
+  energy_returned_tariff2,
+  power_delivered,
+  power_delivered_l1,
+  power_delivered_l2,
+  power_delivered_l3,
+  power_returned,
+  power_returned_l1,
+  power_returned_l2,
+  power_returned_l3,
+  voltage_l1,
+  voltage_l2,
+  voltage_l3,
+  current_l1,
+  current_l2,
+  current_l3,
+  field_count
+};
+
+// The fluvius_smart_meter_gas measurement of the electricity_gas_water sketch
+enum class FluviusGasField : uint8_t
+{
+  gas_device_type,    // Integer, stored as a string
+  gas_valve_position, // Integer
+  gas_m3,             // Milli-units
+  field_count
+};
@@ -0,0 +1,297 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <atomic>
+#include <string.h>
+#include "espnow_reading.h"
+#ifdef ESP32
+#include <esp_now.h>
+#include <WiFi.h>
+#endif
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// A received reading, handed to EspNowGateway::process(...)
+struct NodeReading
+{
+  uint8_t mac[6];
+  uint32_t receive_timestamp_msecs;
+  NodeReadingPacket packet;
+};
+
+// Counts since boot
+struct EspNowGatewayStats
+{
+  uint32_t received;        // Frames received, including the ones dropped below
+  uint32_t invalid;         // Not a NodeReadingPacket
+  uint32_t queue_overflows; // Dropped because process(...) didn't keep up
+  uint32_t duplicates;      // Retries of readings that were already forwarded, or readings too old to tell
+  uint32_t unknown_nodes;   // Dropped because max_nodes other nodes were seen already
+  uint32_t forwarded;
+  uint16_t node_count;
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Receives NodeReadingPackets from many battery-powered sensor nodes over esp-now (see EspNowNode), and hands every reading to the sketch once.
+ * Nodes don't connect to the access point themselves, they wake up, send one frame and go back to sleep.
+ *
+ * Nodes retry a frame whose acknowledgement got lost, so the same reading can arrive several times.
+ * Readings are deduplicated per node (mac address) on their session and sequence number: the highest sequence seen so far
+ * and a bitmap of the 32 before it, so readings that arrive out of order are still accepted once.
+ * Node state lives in a fixed table of max_nodes entries, nodes beyond that are ignored (and counted).
+ *
+ * on_receive(...) runs on the wifi task on esp32, so it only validates frames and queues them in a lock-free single-producer
+ * single-consumer queue, process(...) does the rest on the loop task.
+ * Neither depends on esp-now itself, so the gateway also runs against a simulated radio on the host (see extras/espnow_simulation).
+ */
+template <uint16_t max_nodes, size_t queue_capacity>
+class EspNowGateway
+{
+public:
+#ifdef ESP32
+  // Starts receiving, call once wifi is connected: esp-now then uses the wifi channel of the access point, nodes must send on it too
+  bool begin();
+#endif
+
+  // Only call from a single task (the wifi task on esp32)
+  void on_receive(const uint8_t *mac, const uint8_t *data, int length, uint32_t timestamp_msecs);
+
+  // Calls func(const NodeReading &reading) for every queued reading that wasn't received before, returns how many
+  // Only call from a single task (the loop task)
+  template <typename Func>
+  uint16_t process(Func func);
+
+  bool has_queued_readings() const { return queue_read_index.load(std::memory_order_relaxed) != queue_write_index.load(std::memory_order_relaxed); }
+  EspNowGatewayStats get_stats() const;
+
+private:
+  struct NodeState
+  {
+    uint8_t mac[6];
+    bool is_used;
+    uint32_t session;
+    uint32_t highest_sequence;
+    uint32_t seen_window; // Bit i: highest_sequence - 1 - i was received
+  };
+
+  NodeState *find_or_add_node(const uint8_t *mac);
+  static bool accept_sequence(NodeState &node, uint32_t session, uint32_t sequence);
+
+#ifdef ESP32
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  static void on_espnow_receive(const esp_now_recv_info_t *info, const uint8_t *data, int length);
+#else
+  static void on_espnow_receive(const uint8_t *mac, const uint8_t *data, int length);
+#endif
+#endif
+
+private:
+  // queue_capacity + 1 slots, so a full queue can be told apart from an empty one
+  NodeReading queue[queue_capacity + 1];
+  std::atomic<size_t> queue_write_index{0}; // Only written by on_receive
+  std::atomic<size_t> queue_read_index{0};  // Only written by process
+
+  NodeState nodes[max_nodes] = {};
+  uint16_t node_count = 0;
+
+  // Written by on_receive
+  std::atomic<uint32_t> received{0};
+  std::atomic<uint32_t> invalid{0};
+  std::atomic<uint32_t> queue_overflows{0};
+  // Written by process
+  uint32_t duplicates = 0;
+  uint32_t unknown_nodes = 0;
+  uint32_t forwarded = 0;
+
+  static EspNowGateway *receiving_instance; // Esp-now calls back a plain function
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+#ifdef ESP32
+template <uint16_t max_nodes, size_t queue_capacity>
+bool EspNowGateway<max_nodes, queue_capacity>::begin()
+{
+  receiving_instance = this;
+  WiFi.setSleep(false); // Modem sleep would miss frames
+  if (esp_now_init() != ESP_OK)
+    return false;
+  return esp_now_register_recv_cb(on_espnow_receive) == ESP_OK;
+}
+#endif
+
+template <uint16_t max_nodes, size_t queue_capacity>
+void EspNowGateway<max_nodes, queue_capacity>::on_receive(const uint8_t *mac, const uint8_t *data, int length, uint32_t timestamp_msecs)
+{
+  received.fetch_add(1, std::memory_order_relaxed);
+
+  // The used values follow the header, nothing else
+  if (length < (int)node_reading_header_size || data[0] != node_reading_packet_version ||
+      data[2] == 0 || data[2] > max_node_reading_values || length != (int)(node_reading_header_size + data[2] * sizeof(int32_t)))
+  {
+    invalid.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const size_t write_index = queue_write_index.load(std::memory_order_relaxed);
+  const size_t next_write_index = (write_index + 1) % (queue_capacity + 1);
+  if (next_write_index == queue_read_index.load(std::memory_order_acquire))
+  {
+    queue_overflows.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  NodeReading &reading = queue[write_index];
+  memcpy(reading.mac, mac, sizeof(reading.mac));
+  reading.receive_timestamp_msecs = timestamp_msecs;
+  memset(&reading.packet, 0, sizeof(reading.packet));
+  memcpy(&reading.packet, data, length);
+  queue_write_index.store(next_write_index, std::memory_order_release);
+}
+
+template <uint16_t max_nodes, size_t queue_capacity>
+template <typename Func>
+uint16_t EspNowGateway<max_nodes, queue_capacity>::process(Func func)
+{
+  uint16_t forwarded_count = 0;
+  size_t read_index = queue_read_index.load(std::memory_order_relaxed);
+  while (read_index != queue_write_index.load(std::memory_order_acquire))
+  {
+    const NodeReading &reading = queue[read_index];
+
+    NodeState *node = find_or_add_node(reading.mac);
+    if (node == nullptr)
+    {
+      unknown_nodes++;
+    }
+    else if (!accept_sequence(*node, reading.packet.session, reading.packet.sequence))
+    {
+      duplicates++;
+    }
+    else
+    {
+      func(reading);
+      forwarded++;
+      forwarded_count++;
+    }
+
+    read_index = (read_index + 1) % (queue_capacity + 1);
+    queue_read_index.store(read_index, std::memory_order_release); // Frees the slot for on_receive
+  }
+  return forwarded_count;
+}
+
+template <uint16_t max_nodes, size_t queue_capacity>
+EspNowGatewayStats EspNowGateway<max_nodes, queue_capacity>::get_stats() const
+{
+  EspNowGatewayStats stats;
+  stats.received = received.load(std::memory_order_relaxed);
+  stats.invalid = invalid.load(std::memory_order_relaxed);
+  stats.queue_overflows = queue_overflows.load(std::memory_order_relaxed);
+  stats.duplicates = duplicates;
+  stats.unknown_nodes = unknown_nodes;
+  stats.forwarded = forwarded;
+  stats.node_count = node_count;
+  return stats;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+// Open addressing on a hash of the mac address, nodes are never removed
+template <uint16_t max_nodes, size_t queue_capacity>
+typename EspNowGateway<max_nodes, queue_capacity>::NodeState *EspNowGateway<max_nodes, queue_capacity>::find_or_add_node(const uint8_t *mac)
+{
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (uint8_t i = 0; i < 6; i++)
+    hash = (hash ^ mac[i]) * 16777619u;
+
+  for (uint16_t probe = 0; probe < max_nodes; probe++)
+  {
+    NodeState &node = nodes[(hash + probe) % max_nodes];
+    if (node.is_used && memcmp(node.mac, mac, sizeof(node.mac)) == 0)
+      return &node;
+    if (!node.is_used)
+    {
+      memcpy(node.mac, mac, sizeof(node.mac));
+      node.is_used = true;
+      node.session = 0; // No session yet, the first reading starts one
+      node_count++;
+      return &node;
+    }
+  }
+  return nullptr;
+}
+
+template <uint16_t max_nodes, size_t queue_capacity>
+bool EspNowGateway<max_nodes, queue_capacity>::accept_sequence(NodeState &node, uint32_t session, uint32_t sequence)
+{
+  // The node rebooted (or this is its first reading), its sequence numbers start over
+  if (session != node.session)
+  {
+    node.session = session;
+    node.highest_sequence = sequence;
+    node.seen_window = 0;
+    return true;
+  }
+
+  if (sequence > node.highest_sequence)
+  {
+    const uint32_t shift = sequence - node.highest_sequence;
+    // The previous highest sequence becomes bit shift - 1
+    if (shift < 32)
+      node.seen_window = (node.seen_window << shift) | (1u << (shift - 1));
+    else
+      node.seen_window = shift == 32 ? 1u << 31 : 0;
+    node.highest_sequence = sequence;
+    return true;
+  }
+
+  const uint32_t age = node.highest_sequence - sequence;
+  if (age == 0 || age > 32)
+    return false; // A duplicate of the highest, or too old to tell, dropping it is the safe side
+  const uint32_t bit = 1u << (age - 1);
+  if (node.seen_window & bit)
+    return false;
+  node.seen_window |= bit;
+  return true;
+}
+
+///                                  ///
+// Static class attribute definitions //
+///                                  ///
+
+template <uint16_t max_nodes, size_t queue_capacity>
+EspNowGateway<max_nodes, queue_capacity> *EspNowGateway<max_nodes, queue_capacity>::receiving_instance = nullptr;
+
+///         ///
+// Callbacks //
+///         ///
+
+#ifdef ESP32
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+template <uint16_t max_nodes, size_t queue_capacity>
+void EspNowGateway<max_nodes, queue_capacity>::on_espnow_receive(const esp_now_recv_info_t *info, const uint8_t *data, int length)
+{
+  receiving_instance->on_receive(info->src_addr, data, length, millis());
+}
+#else
+template <uint16_t max_nodes, size_t queue_capacity>
+void EspNowGateway<max_nodes, queue_capacity>::on_espnow_receive(const uint8_t *mac, const uint8_t *data, int length)
+{
+  receiving_instance->on_receive(mac, data, length, millis());
+}
+#endif
+#endif
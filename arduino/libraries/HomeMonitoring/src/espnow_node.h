@@ -0,0 +1,174 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <string.h>
+#include "espnow_reading.h"
+#if defined(ESP8266)
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+#elif defined(ESP32)
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#endif
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Sends readings of a battery-powered sensor node to an EspNowGateway, see the espnow_node_example sketch.
+ * Radio needs bool send(const uint8_t *peer_mac, const uint8_t *data, uint8_t length), returning whether the gateway acknowledged
+ * the frame: EspNowRadio on esp32 and esp8266, a simulated radio on the host (see extras/espnow_simulation).
+ *
+ * session and sequence are references, so the sketch can keep them in memory that survives deep sleep.
+ * A reading is retried with the same sequence number when its acknowledgement doesn't arrive, the gateway drops the duplicates
+ * in case only the acknowledgement got lost.
+ */
+template <typename Radio>
+class EspNowNode
+{
+public:
+  EspNowNode(Radio &radio, const uint8_t *gateway_mac, uint32_t &session, uint32_t &sequence, uint8_t max_attempts = 3)
+      : radio(radio), gateway_mac(gateway_mac), session(session), sequence(sequence), max_attempts(max_attempts) {}
+
+  // Returns whether the gateway acknowledged the reading
+  bool send_reading(uint8_t measurement, const int32_t *milli_values, uint8_t value_count);
+
+private:
+  Radio &radio;
+  const uint8_t *gateway_mac;
+  uint32_t &session;
+  uint32_t &sequence;
+  const uint8_t max_attempts;
+};
+
+#if defined(ESP32) || defined(ESP8266)
+// Esp-now on the wifi radio, without connecting to an access point
+class EspNowRadio
+{
+public:
+  // channel must be the wifi channel of the access point the gateway is connected to
+  bool begin(const uint8_t *gateway_mac, uint8_t channel);
+  // Blocks until the frame was acknowledged or not, at most send_timeout_msecs
+  bool send(const uint8_t *peer_mac, const uint8_t *data, uint8_t length);
+
+private:
+#if defined(ESP8266)
+  static void on_send(uint8_t *mac, uint8_t status);
+#elif ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+  static void on_send(const wifi_tx_info_t *tx_info, esp_now_send_status_t status);
+#else
+  static void on_send(const uint8_t *mac, esp_now_send_status_t status);
+#endif
+
+private:
+  static constexpr uint32_t send_timeout_msecs = 100;
+
+  static volatile bool is_send_done; // Set by on_send
+  static volatile bool is_send_acknowledged;
+};
+#endif
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Radio>
+bool EspNowNode<Radio>::send_reading(uint8_t measurement, const int32_t *milli_values, uint8_t value_count)
+{
+  if (value_count == 0 || value_count > max_node_reading_values)
+    return false;
+
+  NodeReadingPacket packet = {};
+  packet.version = node_reading_packet_version;
+  packet.measurement = measurement;
+  packet.value_count = value_count;
+  packet.session = session;
+  packet.sequence = ++sequence; // Once per reading, retries reuse it
+  memcpy(packet.milli_values, milli_values, value_count * sizeof(int32_t));
+
+  const uint8_t length = node_reading_header_size + value_count * sizeof(int32_t);
+  for (uint8_t attempt = 0; attempt < max_attempts; attempt++)
+    if (radio.send(gateway_mac, (const uint8_t *)&packet, length))
+      return true;
+  return false;
+}
+
+#if defined(ESP32) || defined(ESP8266)
+bool EspNowRadio::begin(const uint8_t *gateway_mac, uint8_t channel)
+{
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect();
+#if defined(ESP8266)
+  wifi_set_channel(channel);
+  if (esp_now_init() != 0)
+    return false;
+  esp_now_set_self_role(ESP_NOW_ROLE_CONTROLLER);
+  esp_now_register_send_cb(on_send);
+  return esp_now_add_peer((uint8_t *)gateway_mac, ESP_NOW_ROLE_SLAVE, channel, nullptr, 0) == 0;
+#else
+  esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+  if (esp_now_init() != ESP_OK)
+    return false;
+  esp_now_register_send_cb(on_send);
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, gateway_mac, sizeof(peer.peer_addr));
+  peer.channel = channel;
+  peer.encrypt = false;
+  return esp_now_add_peer(&peer) == ESP_OK;
+#endif
+}
+
+bool EspNowRadio::send(const uint8_t *peer_mac, const uint8_t *data, uint8_t length)
+{
+  is_send_done = false;
+  is_send_acknowledged = false;
+#if defined(ESP8266)
+  if (esp_now_send((uint8_t *)peer_mac, (uint8_t *)data, length) != 0)
+    return false;
+#else
+  if (esp_now_send(peer_mac, data, length) != ESP_OK)
+    return false;
+#endif
+
+  const uint32_t start_msecs = millis();
+  while (!is_send_done && millis() - start_msecs < send_timeout_msecs)
+    delay(1);
+  return is_send_acknowledged;
+}
+
+///                                  ///
+// Static class attribute definitions //
+///                                  ///
+
+volatile bool EspNowRadio::is_send_done = false;
+volatile bool EspNowRadio::is_send_acknowledged = false;
+
+///         ///
+// Callbacks //
+///         ///
+
+#if defined(ESP8266)
+void EspNowRadio::on_send(uint8_t *mac, uint8_t status)
+{
+  is_send_acknowledged = status == 0;
+  is_send_done = true;
+}
+#elif ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+void EspNowRadio::on_send(const wifi_tx_info_t *tx_info, esp_now_send_status_t status)
+{
+  is_send_acknowledged = status == ESP_NOW_SEND_SUCCESS;
+  is_send_done = true;
+}
+#else
+void EspNowRadio::on_send(const uint8_t *mac, esp_now_send_status_t status)
+{
+  is_send_acknowledged = status == ESP_NOW_SEND_SUCCESS;
+  is_send_done = true;
+}
+#endif
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stddef.h>
+#include <stdint.h>
+
+///         ///
+// Constants //
+///         ///
+
+static constexpr uint8_t node_reading_packet_version = 1;
+static constexpr uint8_t max_node_reading_values = 4;
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+/*
+ * Reading sent by a sensor node to an EspNowGateway, as a single esp-now frame.
+ * Only the header and the used milli_values are sent (16 to 28 bytes). Both esp32 and esp8266 are little-endian.
+ * The node is identified by the mac address the frame came from.
+ */
+struct __attribute__((packed)) NodeReadingPacket
+{
+  uint8_t version;     // node_reading_packet_version
+  uint8_t measurement; // Index in the gateway's NodeMeasurement table
+  uint8_t value_count; // Used entries of milli_values
+  uint8_t reserved;    // 0
+  uint32_t session;    // Random, picked at every cold boot of the node, so its sequence numbers can start over
+  uint32_t sequence;   // Starts at 1, incremented for every new reading (not for retries of the same reading)
+  int32_t milli_values[max_node_reading_values]; // Values in milli-units, like FixedValue (e.g. 1.234 is 1234)
+};
+
+// Bytes before milli_values, a packet is node_reading_header_size + value_count * 4 bytes long
+static constexpr size_t node_reading_header_size = offsetof(NodeReadingPacket, milli_values);
+
+// How the gateway turns the readings of one kind of node into data points
+struct NodeMeasurement
+{
+  const char *bucket;
+  const char *measurement;
+  const char *field_names[max_node_reading_values]; // One per milli_values entry
+};
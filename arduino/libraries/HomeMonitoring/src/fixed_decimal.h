@@ -0,0 +1,53 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stdint.h>
+#include <stddef.h>
+
+///         ///
+// Constants //
+///         ///
+
+// Longest output of format_milli_value: "-9223372036854775.808"
+static constexpr size_t milli_value_max_length = 21;
+
+///                    ///
+// Function definitions //
+///                    ///
+
+/*
+ * Writes a value given in milli-units (e.g. Wh for a kWh value) as a decimal number with exactly 3 decimals.
+ * Uses integer math only, so it is exact for the whole range (unlike converting to float first).
+ * buffer must hold at least milli_value_max_length chars, no null terminator is written.
+ * Returns the number of chars written.
+ */
+size_t format_milli_value(int64_t milli_value, char *buffer)
+{
+  // Work on the magnitude as unsigned, so INT64_MIN doesn't overflow
+  const bool is_negative = milli_value < 0;
+  uint64_t magnitude = is_negative ? 0 - (uint64_t)milli_value : (uint64_t)milli_value;
+
+  // Fill a scratch buffer from the back: 3 decimals, the point, then at least one integer digit
+  char reversed[milli_value_max_length];
+  size_t length = 0;
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    reversed[length++] = '0' + (magnitude % 10);
+    magnitude /= 10;
+  }
+  reversed[length++] = '.';
+  do
+  {
+    reversed[length++] = '0' + (magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (is_negative)
+    reversed[length++] = '-';
+
+  for (size_t i = 0; i < length; i++)
+    buffer[i] = reversed[length - 1 - i];
+  return length;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Gzip compressor for messages that are already in memory, like a batch of json data points.
+ * Json batches repeat the same keys in every point, so even a simple compressor shrinks them several times:
+ *   - Greedy LZ77, a hash table keeps the last 4 positions of every 3-byte prefix (hash) as match candidates
+ *   - The input itself is the window (so at most 32 KB, the deflate limit), nothing is copied
+ *   - One deflate block with the fixed huffman codes, no code tables to build or send
+ * Memory is the output buffer (max_input_size bytes) and a 4 KB hash table, nothing is allocated.
+ * Plain C++ without Arduino dependencies, so it can be benchmarked on the host (see extras/gzip_benchmark).
+ */
+template <size_t max_input_size>
+class GzipCompressor
+{
+public:
+  static_assert(max_input_size <= 32768, "Deflate can't refer back further than 32 KB");
+
+  // Returns the compressed length, or 0 if that isn't smaller than length (send the input as-is then)
+  size_t compress(const char *input, size_t length);
+  const uint8_t *get_output() const { return output; }
+
+private:
+  void write_bits(uint32_t bits, uint8_t bit_count);
+  void write_huffman_code(uint16_t code, uint8_t bit_count);
+  void write_literal_or_length_symbol(uint16_t symbol);
+  void write_match(uint16_t length, uint16_t distance);
+  void insert_position(const char *input, size_t position);
+
+  static uint16_t hash(const char *data);
+  static uint32_t crc32(const char *data, size_t length);
+
+private:
+  static constexpr uint8_t hash_bits = 9;
+  static constexpr uint8_t bucket_size = 4; // More candidates find longer matches, see extras/gzip_benchmark for the trade-off
+  static constexpr uint16_t min_match_length = 3;
+  static constexpr uint16_t max_match_length = 258;
+
+  // Deflate's length and distance codes (rfc 1951, 3.2.5): the smallest value of every code and its number of extra bits
+  static constexpr uint16_t length_bases[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static constexpr uint8_t length_extra_bits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  static constexpr uint16_t distance_bases[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  static constexpr uint8_t distance_extra_bits[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+  uint16_t hash_table[1 << hash_bits][bucket_size]; // Position + 1 of the last 3-byte prefixes with this hash, newest first, 0 = none
+  uint8_t output[max_input_size];
+  size_t output_length = 0;
+  bool is_output_full = false;
+
+  uint32_t bit_buffer = 0; // Bits that don't fill a byte yet
+  uint8_t bit_buffer_count = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <size_t max_input_size>
+size_t GzipCompressor<max_input_size>::compress(const char *input, size_t length)
+{
+  if (length > max_input_size)
+    return 0;
+
+  memset(hash_table, 0, sizeof(hash_table));
+  output_length = 0;
+  is_output_full = false;
+  bit_buffer = 0;
+  bit_buffer_count = 0;
+
+  // Gzip header: magic, deflate, no flags, no mtime, no extra flags, unknown os
+  static constexpr uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+  for (uint8_t header_byte : header)
+    write_bits(header_byte, 8);
+
+  write_bits(1, 1); // Last block
+  write_bits(1, 2); // Fixed huffman codes
+
+  size_t position = 0;
+  while (position < length && !is_output_full)
+  {
+    uint16_t match_length = 0;
+    size_t match_position = 0;
+    if (position + min_match_length <= length)
+    {
+      // Longest match among the candidates
+      const uint16_t *bucket = hash_table[hash(input + position)];
+      const size_t max_length = length - position < max_match_length ? length - position : max_match_length;
+      for (uint8_t i = 0; i < bucket_size && bucket[i] != 0; i++)
+      {
+        const size_t candidate_position = bucket[i] - 1;
+        uint16_t candidate_length = 0;
+        while (candidate_length < max_length && input[candidate_position + candidate_length] == input[position + candidate_length])
+          candidate_length++;
+        if (candidate_length > match_length)
+        {
+          match_length = candidate_length;
+          match_position = candidate_position;
+        }
+      }
+      insert_position(input, position);
+    }
+
+    if (match_length < min_match_length)
+    {
+      write_literal_or_length_symbol((uint8_t)input[position]);
+      position++;
+      continue;
+    }
+
+    write_match(match_length, position - match_position);
+    // Positions within the match can start later matches too
+    const size_t match_end = position + match_length;
+    for (position++; position < match_end; position++)
+      if (position + min_match_length <= length)
+        insert_position(input, position);
+  }
+
+  write_literal_or_length_symbol(256); // End of block
+  if (bit_buffer_count > 0)
+    write_bits(0, 8 - bit_buffer_count);
+
+  // Gzip trailer: crc32 and length of the input, little-endian
+  const uint32_t crc = crc32(input, length);
+  write_bits(crc & 0xffff, 16);
+  write_bits(crc >> 16, 16);
+  write_bits(length & 0xffff, 16);
+  write_bits(length >> 16, 16);
+
+  if (is_output_full || output_length >= length)
+    return 0;
+  return output_length;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+// Deflate packs bits starting at the least significant bit of every byte
+template <size_t max_input_size>
+void GzipCompressor<max_input_size>::write_bits(uint32_t bits, uint8_t bit_count)
+{
+  bit_buffer |= bits << bit_buffer_count;
+  bit_buffer_count += bit_count;
+  while (bit_buffer_count >= 8)
+  {
+    if (output_length < max_input_size)
+      output[output_length++] = bit_buffer & 0xff;
+    else
+      is_output_full = true;
+    bit_buffer >>= 8;
+    bit_buffer_count -= 8;
+  }
+}
+
+// Huffman codes are packed starting at their most significant bit
+template <size_t max_input_size>
+void GzipCompressor<max_input_size>::write_huffman_code(uint16_t code, uint8_t bit_count)
+{
+  uint16_t reversed_code = 0;
+  for (uint8_t i = 0; i < bit_count; i++)
+  {
+    reversed_code = (reversed_code << 1) | (code & 1);
+    code >>= 1;
+  }
+  write_bits(reversed_code, bit_count);
+}
+
+// The fixed literal/length code (rfc 1951, 3.2.6)
+template <size_t max_input_size>
+void GzipCompressor<max_input_size>::write_literal_or_length_symbol(uint16_t symbol)
+{
+  if (symbol < 144)
+    write_huffman_code(0x30 + symbol, 8);
+  else if (symbol < 256)
+    write_huffman_code(0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    write_huffman_code(symbol - 256, 7);
+  else
+    write_huffman_code(0xc0 + symbol - 280, 8);
+}
+
+template <size_t max_input_size>
+void GzipCompressor<max_input_size>::write_match(uint16_t length, uint16_t distance)
+{
+  uint8_t length_code = 28;
+  while (length_bases[length_code] > length)
+    length_code--;
+  write_literal_or_length_symbol(257 + length_code);
+  write_bits(length - length_bases[length_code], length_extra_bits[length_code]);
+
+  uint8_t distance_code = 29;
+  while (distance_bases[distance_code] > distance)
+    distance_code--;
+  write_huffman_code(distance_code, 5); // Fixed distance codes are 5 bits each
+  write_bits(distance - distance_bases[distance_code], distance_extra_bits[distance_code]);
+}
+
+// Makes position the newest candidate of its bucket, the oldest one is dropped
+template <size_t max_input_size>
+void GzipCompressor<max_input_size>::insert_position(const char *input, size_t position)
+{
+  uint16_t *bucket = hash_table[hash(input + position)];
+  memmove(bucket + 1, bucket, (bucket_size - 1) * sizeof(uint16_t));
+  bucket[0] = position + 1;
+}
+
+template <size_t max_input_size>
+uint16_t GzipCompressor<max_input_size>::hash(const char *data)
+{
+  const uint32_t prefix = ((uint32_t)(uint8_t)data[0] << 16) | ((uint32_t)(uint8_t)data[1] << 8) | (uint8_t)data[2];
+  return (prefix * 2654435761u) >> (32 - hash_bits); // Fibonacci hashing
+}
+
+// Crc-32 as used by gzip, with a 16-entry table (one lookup per nibble)
+template <size_t max_input_size>
+uint32_t GzipCompressor<max_input_size>::crc32(const char *data, size_t length)
+{
+  static constexpr uint32_t nibble_table[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+      0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= (uint8_t)data[i];
+    crc = (crc >> 4) ^ nibble_table[crc & 0xf];
+    crc = (crc >> 4) ^ nibble_table[crc & 0xf];
+  }
+  return ~crc;
+}
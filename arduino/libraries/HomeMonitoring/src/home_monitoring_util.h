@@ -1,12 +1,28 @@
 #pragma once
 
+///        ///
+// Includes //
+///        ///
+
 #include <ArduinoJson.h>
 
 #define byte char
 #define ubyte unsigned char
 
+///                    ///
+// Function definitions //
+///                    ///
+
+void print_sketch_version(const String &version_stamp, const String &file_name)
+{
+  Serial.println(String("Sketch File    : ") + file_name);
+  Serial.println(String("Sketch version : ") + version_stamp);
+  Serial.println(
+      String("Compiled: ") + String(__DATE__) + String(", ") + String(__TIME__) + String(", IDE version: ") + String(__VERSION__) + String("\n"));
+}
+
 // Runs for the first time when millis() == interval_msecs
-template<typename T>
+template <typename T>
 void run_in_interval_nonblocking(uint32_t *const state, const uint32_t interval_msecs, T func)
 {
   uint32_t &last_send_timestamp_msecs = *state;
@@ -45,6 +61,10 @@ DynamicJsonParseResult dynamic_json_parse(String &json_string, size_t document_c
     }
     result.success = false;
   }
-  
+  else
+  {
+    result.success = true;
+  }
+
   return result;
 }
@@ -0,0 +1,220 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Responses of the collector since boot
+struct HttpResponseStats
+{
+  uint32_t responses = 0;
+  uint32_t throttled_responses = 0; // Asked to slow down (Retry-After)
+  uint32_t rejected_messages = 0;   // Error status, the collector did not take the message (e.g. 429 when its queue is full)
+};
+
+// What became of a request, see HttpResponseReader::get_request_outcome
+enum class RequestOutcome : uint8_t
+{
+  pending,    // Not answered yet
+  accepted,   // Answered with a success status
+  rejected,   // Answered with an error status, the collector dropped the message (e.g. 429 when its queue is full)
+  unanswered, // The connection closed before its response arrived, or it was answered too long ago to tell
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Reads the responses to pipelined requests as they come in, without blocking and without allocating.
+ * Only the status code and the Retry-After and Content-Length headers are looked at, bodies are skipped.
+ * The collector sends Retry-After while it falls behind, it holds until a response without it arrives.
+ * Responses arrive in request order, so each is matched to its request: the outcomes of the last 32 requests are kept.
+ * The reader only tells which requests were rejected, resending them is up to the caller (PointBatch does).
+ */
+class HttpResponseReader
+{
+public: // Constants
+  static constexpr uint32_t max_retry_after_secs = 600; // Caps what a (misconfigured) server can ask for
+
+public: // Public methods
+  template <typename Socket>
+  void read_available(Socket &socket);
+  // Call after the connection closed: drops a partially read response, the requests still waiting for theirs become unanswered
+  // The last Retry-After still holds
+  void reset();
+
+  // Call after sending each request, returns its number (counted since boot, starting at 1)
+  uint32_t count_request() { return ++sent_requests; }
+  uint32_t get_sent_request_count() const { return sent_requests; }
+  RequestOutcome get_request_outcome(uint32_t request_number) const;
+
+  // The Retry-After of the last response, 0 if it had none
+  uint32_t get_retry_after_msecs() const { return retry_after_msecs; }
+  const HttpResponseStats &get_stats() const { return stats; }
+
+private: // Private methods
+  void read_char(char c);
+  void read_line();
+  void finish_response();
+  void clear_response();
+  void shift_answered_requests(uint32_t count, bool is_rejected, bool is_unanswered);
+
+private: // Attributes
+  char line[48]; // Longer lines are cut off, none of the lines that matter are that long
+  uint8_t line_length = 0;
+  bool has_status_line = false;
+  uint16_t status = 0;
+  int32_t response_retry_after_secs = -1; // -1 = no Retry-After header
+  uint32_t remaining_body_length = 0;
+  bool is_reading_body = false;
+
+  uint32_t retry_after_msecs = 0;
+  HttpResponseStats stats;
+
+  uint32_t sent_requests = 0;
+  uint32_t answered_requests = 0;       // Also the number of the last answered request
+  uint32_t rejected_request_bits = 0;   // Bit n: request answered_requests - n was rejected
+  uint32_t unanswered_request_bits = 0; // Bit n: request answered_requests - n lost its response
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Socket>
+void HttpResponseReader::read_available(Socket &socket)
+{
+  uint8_t buffer[16];
+  int available;
+  while ((available = socket.available()) >= 1)
+  {
+    const int length = socket.read(buffer, available < (int)sizeof(buffer) ? available : sizeof(buffer));
+    if (length <= 0)
+      return;
+    for (int i = 0; i < length; i++)
+      read_char(buffer[i]);
+  }
+}
+
+void HttpResponseReader::reset()
+{
+  clear_response();
+  shift_answered_requests(sent_requests - answered_requests, false, true);
+}
+
+RequestOutcome HttpResponseReader::get_request_outcome(uint32_t request_number) const
+{
+  if (request_number > answered_requests)
+    return RequestOutcome::pending;
+  const uint32_t age = answered_requests - request_number;
+  if (age >= 32 || (unanswered_request_bits & (1UL << age)) != 0)
+    return RequestOutcome::unanswered;
+  return (rejected_request_bits & (1UL << age)) != 0 ? RequestOutcome::rejected : RequestOutcome::accepted;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+void HttpResponseReader::read_char(char c)
+{
+  if (is_reading_body)
+  {
+    if (--remaining_body_length == 0)
+      finish_response();
+    return;
+  }
+
+  if (c == '\r')
+    return;
+  if (c != '\n')
+  {
+    if (line_length < sizeof(line) - 1)
+      line[line_length++] = c;
+    return;
+  }
+
+  line[line_length] = '\0';
+  read_line();
+  line_length = 0;
+}
+
+void HttpResponseReader::read_line()
+{
+  // Status line, e.g. "HTTP/1.1 429 TOO MANY REQUESTS"
+  if (!has_status_line)
+  {
+    const char *space = strchr(line, ' ');
+    status = space != nullptr ? atoi(space + 1) : 0;
+    has_status_line = true;
+    return;
+  }
+
+  // An empty line ends the headers
+  if (line_length == 0)
+  {
+    if (remaining_body_length > 0)
+      is_reading_body = true;
+    else
+      finish_response();
+    return;
+  }
+
+  static const char retry_after_header[] = "retry-after:";
+  static const char content_length_header[] = "content-length:";
+  if (strncasecmp(line, retry_after_header, sizeof(retry_after_header) - 1) == 0)
+    response_retry_after_secs = atoi(line + sizeof(retry_after_header) - 1); // atoi skips the leading spaces
+  else if (strncasecmp(line, content_length_header, sizeof(content_length_header) - 1) == 0)
+    remaining_body_length = atoi(line + sizeof(content_length_header) - 1);
+}
+
+void HttpResponseReader::finish_response()
+{
+  stats.responses++;
+  if (status >= 400)
+    stats.rejected_messages++;
+  if (answered_requests < sent_requests) // Ignores responses to requests that weren't counted
+    shift_answered_requests(1, status >= 400, false);
+  if (response_retry_after_secs >= 0)
+  {
+    stats.throttled_responses++;
+    const uint32_t retry_after_secs = (uint32_t)response_retry_after_secs < max_retry_after_secs ? response_retry_after_secs : max_retry_after_secs;
+    retry_after_msecs = retry_after_secs * 1000;
+  }
+  else
+  {
+    retry_after_msecs = 0; // The collector caught up
+  }
+  clear_response();
+}
+
+void HttpResponseReader::clear_response()
+{
+  line_length = 0;
+  has_status_line = false;
+  status = 0;
+  response_retry_after_secs = -1;
+  remaining_body_length = 0;
+  is_reading_body = false;
+}
+
+// Marks the next count requests as answered, all with the same outcome
+void HttpResponseReader::shift_answered_requests(uint32_t count, bool is_rejected, bool is_unanswered)
+{
+  if (count == 0)
+    return;
+  const uint32_t new_bits = count >= 32 ? UINT32_MAX : (1UL << count) - 1;
+  rejected_request_bits = (count >= 32 ? 0 : rejected_request_bits << count) | (is_rejected ? new_bits : 0);
+  unanswered_request_bits = (count >= 32 ? 0 : unanswered_request_bits << count) | (is_unanswered ? new_bits : 0);
+  answered_requests += count;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <array>
+#include <ArduinoJson.h>
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Filled in by a command handler, sent back on the response topic
+struct CommandReply
+{
+  bool success = true;
+  char message[64] = "";
+
+  void set_error(const char *error_message)
+  {
+    success = false;
+    strncpy(message, error_message, sizeof(message) - 1);
+  }
+};
+
+// Arguments of commands that take none
+struct NoCommandArgs
+{
+  static constexpr size_t json_capacity = 0; // The payload is not even parsed
+  static bool decode(JsonObjectConst /* json */, NoCommandArgs &/* args */) { return true; }
+};
+
+///                   ///
+// Constexpr functions //
+///                   ///
+
+constexpr size_t constexpr_strlen(const char *str)
+{
+  size_t length = 0;
+  while (str[length] != '\0')
+    length++;
+  return length;
+}
+
+// FNV-1a, with a seed mixed into the offset basis
+constexpr uint32_t command_name_hash(const char *name, size_t length, uint32_t seed)
+{
+  uint32_t hash = 2166136261u ^ seed;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (uint8_t)name[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Dispatches mqtt commands by name to handlers that are all known at compile time.
+ *
+ * A command is a type like:
+ *   struct SetBrightnessCommand
+ *   {
+ *     static constexpr const char *name = "set_brightness";
+ *     struct Args
+ *     {
+ *       uint8_t brightness;
+ *       static constexpr size_t json_capacity = JSON_OBJECT_SIZE(1); // StaticJsonDocument size for the payload
+ *       static bool decode(JsonObjectConst json, Args &args); // Returns false on invalid arguments
+ *     };
+ *     static void handle(const Args &args, CommandReply &reply);
+ *   };
+ *
+ * The command names get a perfect hash at compile time (a seed is searched for which no two names collide),
+ * so finding the handler is one hash of the name, one jump table lookup and one string compare,
+ * however many commands there are. The payload is decoded into the command's Args in a StaticJsonDocument
+ * sized for that command, nothing is allocated on the heap.
+ */
+template <typename... Commands>
+class CommandDispatcher
+{
+public:
+  static_assert(sizeof...(Commands) > 0, "CommandDispatcher needs at least one command");
+
+  // Returns false (and sets an error on reply) if the command is unknown or its arguments are invalid
+  static bool dispatch(const char *name, size_t name_length, const char *payload, size_t payload_length, CommandReply &reply);
+
+private:
+  using Handler = bool (*)(const char *payload, size_t payload_length, CommandReply &reply);
+
+  struct Slot
+  {
+    const char *name = nullptr;
+    Handler handler = nullptr;
+  };
+
+  static constexpr size_t table_size_for(size_t command_count)
+  {
+    size_t size = 1;
+    while (size < 2 * command_count)
+      size *= 2;
+    return size;
+  }
+  static constexpr size_t table_size = table_size_for(sizeof...(Commands));
+
+  static constexpr size_t slot_of(const char *name, size_t length, uint32_t seed)
+  {
+    return command_name_hash(name, length, seed) & (table_size - 1);
+  }
+
+  static constexpr bool is_perfect_seed(uint32_t seed)
+  {
+    const char *names[] = {Commands::name...};
+    bool is_used[table_size] = {};
+    for (const char *name : names)
+    {
+      const size_t slot = slot_of(name, constexpr_strlen(name), seed);
+      if (is_used[slot])
+        return false;
+      is_used[slot] = true;
+    }
+    return true;
+  }
+
+  static constexpr uint32_t find_seed()
+  {
+    for (uint32_t seed = 0; seed < 10000; seed++)
+      if (is_perfect_seed(seed))
+        return seed;
+    return UINT32_MAX;
+  }
+  static constexpr uint32_t seed = find_seed();
+  static_assert(seed != UINT32_MAX, "No perfect hash seed found, are two commands named the same?");
+
+  template <typename Command>
+  static bool invoke(const char *payload, size_t payload_length, CommandReply &reply);
+
+  static constexpr std::array<Slot, table_size> build_table()
+  {
+    std::array<Slot, table_size> table = {};
+    const char *names[] = {Commands::name...};
+    const Handler handlers[] = {&invoke<Commands>...};
+    for (size_t i = 0; i < sizeof...(Commands); i++)
+    {
+      Slot &slot = table[slot_of(names[i], constexpr_strlen(names[i]), seed)];
+      slot.name = names[i];
+      slot.handler = handlers[i];
+    }
+    return table;
+  }
+  static constexpr std::array<Slot, table_size> table = build_table();
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename... Commands>
+bool CommandDispatcher<Commands...>::dispatch(const char *name, size_t name_length, const char *payload, size_t payload_length, CommandReply &reply)
+{
+  const Slot &slot = table[slot_of(name, name_length, seed)];
+
+  // Any other name may hash to the same slot
+  if (slot.handler == nullptr || strncmp(slot.name, name, name_length) != 0 || slot.name[name_length] != '\0')
+  {
+    reply.set_error("Unknown command");
+    return false;
+  }
+
+  return slot.handler(payload, payload_length, reply);
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+template <typename... Commands>
+template <typename Command>
+bool CommandDispatcher<Commands...>::invoke(const char *payload, size_t payload_length, CommandReply &reply)
+{
+  using Args = typename Command::Args;
+  Args args = {};
+
+  if constexpr (Args::json_capacity > 0)
+  {
+    StaticJsonDocument<Args::json_capacity> json; // Gets destroyed when leaving this scope
+    if (deserializeJson(json, payload, payload_length) != DeserializationError::Ok)
+    {
+      reply.set_error("Invalid json payload");
+      return false;
+    }
+    if (!Args::decode(json.template as<JsonObjectConst>(), args))
+    {
+      reply.set_error("Invalid arguments");
+      return false;
+    }
+  }
+
+  Command::handle(args, reply);
+  return true;
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+#include <ArduinoJson.h>
+#include "binary_point.h"
+#include "gzip_compressor.h"
+#include "http_response_reader.h"
+#include "wifi_transport.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+enum class WireFormat : uint8_t
+{
+  json,   // A json array of data points
+  binary, // A binary message (binary_point.h), json data points become json records in it
+};
+
+// Largest message a transport can send, transports without a limit don't declare max_message_size
+template <typename Transport, typename = void>
+struct transport_max_message_size
+{
+  static constexpr size_t value = SIZE_MAX;
+};
+
+template <typename Transport>
+struct transport_max_message_size<Transport, std::void_t<decltype(Transport::max_message_size)>>
+{
+  static constexpr size_t value = Transport::max_message_size;
+};
+
+// Whether the server of a transport can ask for a longer delay between batches (WifiHttpClient's collector, when it falls behind)
+template <typename Transport, typename = void>
+struct transport_has_requested_batch_delay : std::false_type
+{
+};
+
+template <typename Transport>
+struct transport_has_requested_batch_delay<Transport, std::void_t<decltype(std::declval<const Transport &>().get_requested_batch_delay_msecs())>>
+    : std::true_type
+{
+};
+
+// Whether a transport tells which of its messages the collector rejected (WifiHttpClient, see HttpResponseReader)
+template <typename Transport, typename = void>
+struct transport_has_request_outcomes : std::false_type
+{
+};
+
+template <typename Transport>
+struct transport_has_request_outcomes<Transport, std::void_t<decltype(std::declval<const Transport &>().get_request_outcome(0))>>
+    : std::true_type
+{
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Collects data points in a fixed buffer as one json array ("[{...},{...}]") and sends them as a single message.
+ * A batch is sent when the next point doesn't fit in max_size anymore, or when its oldest point is max_delay_msecs old.
+ * Points are serialized straight into the buffer, nothing is allocated on the heap.
+ * The buffer is capped at the transport's max_message_size (e.g. one udp datagram).
+ * With a compressor set, batches are sent gzipped whenever that makes them smaller.
+ * With the binary wire format, points added with add_binary(...) are sent as binary point records instead, the collector
+ * writes them the same as their json equivalent. Binary batches are never gzipped, they are mostly numbers already.
+ * While the collector asks devices to slow down (see WifiHttpClient), batches wait at least as long as it asks,
+ * so fewer, fuller batches are sent until it caught up.
+ * With a transport that tells which messages the collector rejected (WifiHttpClient, e.g. 429 while its queue is full),
+ * the last sent message is kept until the collector took it, and sent again once the requested delay passed for as long
+ * as it's rejected, unanswered (the connection closed first) or can't be sent for lack of a connection. Meanwhile the next
+ * batch waits, so only one message is kept, which costs a second buffer. When that batch is full before the collector
+ * took the kept message, the kept message is dropped to send it. Dropped messages are counted, as are messages a
+ * transport without outcomes couldn't send.
+ */
+template <typename Transport, size_t capacity>
+class PointBatch
+{
+public:
+  static constexpr size_t buffer_size = capacity < transport_max_message_size<Transport>::value ? capacity : transport_max_message_size<Transport>::value;
+  using Compressor = GzipCompressor<buffer_size>;
+
+  PointBatch(Transport &transport, const uint32_t max_delay_msecs);
+
+  // Serializes json into the batch, sending the batch first if it doesn't fit anymore
+  // Returns false (and drops the point) if the point is larger than the whole batch
+  template <typename TJsonDocument>
+  bool add(const TJsonDocument &json);
+  // The same, for a point that is only sent in the binary wire format (returns false and drops it otherwise)
+  template <typename Field>
+  bool add_binary(const BinaryPoint<Field> &point);
+
+  void flush_if_due();
+  void flush();
+
+  // Both can be changed at any time, they apply to the next add/flush_if_due
+  void set_max_delay_msecs(uint32_t max_delay_msecs) { this->max_delay_msecs = max_delay_msecs; }
+  // max_delay_msecs, or longer while the transport's server asks for it
+  uint32_t get_effective_max_delay_msecs() const;
+  void set_max_size(size_t max_size) { this->max_size = max_size < buffer_size ? max_size : buffer_size; } // Capped at buffer_size
+  // nullptr = send batches as plain json, the compressor may be shared by batches that are never flushed at the same time
+  void set_compressor(Compressor *compressor) { this->compressor = compressor; }
+  // Sends the current batch first if the format changes
+  void set_wire_format(WireFormat wire_format);
+  WireFormat get_wire_format() const { return wire_format; }
+
+  uint16_t get_point_count() const { return point_count; }
+  uint32_t get_send_micros() const { return send_micros; } // Total time spent compressing and sending since boot
+  // Totals since boot, their ratio is what compression saves
+  uint32_t get_batched_bytes() const { return batched_bytes; }
+  uint32_t get_sent_bytes() const { return sent_bytes; }
+  uint32_t get_resent_messages() const { return resent_messages; }   // Since boot, after the collector rejected them or didn't answer
+  uint32_t get_dropped_messages() const { return dropped_messages; } // Since boot, never taken by the collector
+
+private:
+  // Keeps the last sent message, if the transport tells whether the collector rejected it
+  static constexpr bool keeps_sent_message = transport_has_request_outcomes<Transport>::value;
+
+  enum class SentMessageState : uint8_t
+  {
+    none,              // Nothing kept, the collector took the last message
+    awaiting_response, // Sent, the collector didn't answer yet
+    needs_resend,      // Rejected, unanswered, or not sent at all
+  };
+
+  bool begin_point(size_t point_length);
+  bool send_message(const char *message, size_t message_length, ContentEncoding encoding);
+  SentMessageState check_sent_message();
+
+private:
+  Transport &transport;
+  uint32_t max_delay_msecs;
+  size_t max_size = buffer_size;
+  Compressor *compressor = nullptr;
+  WireFormat wire_format = WireFormat::json;
+
+  char buffer[buffer_size];
+  size_t length = 0;
+  uint16_t point_count = 0;
+  uint32_t first_point_timestamp_msecs = 0;
+  uint32_t send_micros = 0;
+  uint32_t batched_bytes = 0;
+  uint32_t sent_bytes = 0;
+
+  char sent_message[keeps_sent_message ? buffer_size : 1];
+  size_t sent_message_length = 0; // 0 = none kept
+  ContentEncoding sent_message_encoding = ContentEncoding::identity;
+  uint32_t sent_message_request_number = 0; // 0 = the transport couldn't send it (not connected)
+  uint32_t sent_message_timestamp_msecs = 0;
+  uint32_t resent_messages = 0;
+  uint32_t dropped_messages = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Transport, size_t capacity>
+PointBatch<Transport, capacity>::PointBatch(Transport &transport, const uint32_t max_delay_msecs)
+    : transport(transport), max_delay_msecs(max_delay_msecs)
+{
+}
+
+template <typename Transport, size_t capacity>
+template <typename TJsonDocument>
+bool PointBatch<Transport, capacity>::add(const TJsonDocument &json)
+{
+  const size_t json_length = measureJson(json);
+  if (wire_format == WireFormat::json)
+  {
+    if (!begin_point(json_length))
+      return false;
+    length += serializeJson(json, buffer + length, max_size - length);
+    point_count++;
+    return true;
+  }
+
+  if (json_length > UINT16_MAX || !begin_point(binary_json_record_header_size + json_length))
+    return false;
+  write_binary_json_record_header((uint8_t *)buffer + length, json_length);
+  length += binary_json_record_header_size;
+  length += serializeJson(json, buffer + length, max_size - length);
+  point_count++;
+  return true;
+}
+
+template <typename Transport, size_t capacity>
+template <typename Field>
+bool PointBatch<Transport, capacity>::add_binary(const BinaryPoint<Field> &point)
+{
+  if (wire_format != WireFormat::binary || !begin_point(point.measure()))
+    return false;
+  length += point.serialize((uint8_t *)buffer + length);
+  point_count++;
+  return true;
+}
+
+template <typename Transport, size_t capacity>
+void PointBatch<Transport, capacity>::set_wire_format(WireFormat wire_format)
+{
+  if (wire_format == this->wire_format)
+    return;
+  flush();
+  this->wire_format = wire_format;
+}
+
+template <typename Transport, size_t capacity>
+void PointBatch<Transport, capacity>::flush_if_due()
+{
+  // The next batch waits until the collector took the kept message
+  switch (check_sent_message())
+  {
+  case SentMessageState::awaiting_response:
+    return;
+  case SentMessageState::needs_resend:
+    if (millis() - sent_message_timestamp_msecs >= get_effective_max_delay_msecs())
+      resent_messages += send_message(sent_message, sent_message_length, sent_message_encoding);
+    return;
+  default:
+    break;
+  }
+  if (point_count > 0 && millis() - first_point_timestamp_msecs >= get_effective_max_delay_msecs())
+    flush();
+}
+
+template <typename Transport, size_t capacity>
+uint32_t PointBatch<Transport, capacity>::get_effective_max_delay_msecs() const
+{
+  if constexpr (transport_has_requested_batch_delay<Transport>::value)
+  {
+    const uint32_t requested_delay_msecs = transport.get_requested_batch_delay_msecs();
+    return requested_delay_msecs > max_delay_msecs ? requested_delay_msecs : max_delay_msecs;
+  }
+  return max_delay_msecs;
+}
+
+template <typename Transport, size_t capacity>
+void PointBatch<Transport, capacity>::flush()
+{
+  if (point_count == 0)
+    return;
+
+  // This batch can't wait any longer and takes the place of the kept message
+  if (check_sent_message() != SentMessageState::none)
+    dropped_messages++;
+
+  const uint32_t start_micros = micros();
+  size_t compressed_length = 0;
+  if (wire_format == WireFormat::binary)
+  {
+    send_message(buffer, length, ContentEncoding::binary);
+  }
+  else
+  {
+    buffer[length++] = ']';
+    compressed_length = compressor != nullptr ? compressor->compress(buffer, length) : 0;
+    if (compressed_length > 0)
+      send_message((const char *)compressor->get_output(), compressed_length, ContentEncoding::gzip);
+    else
+      send_message(buffer, length, ContentEncoding::identity);
+  }
+  send_micros += micros() - start_micros;
+
+  batched_bytes += length;
+  sent_bytes += compressed_length > 0 ? compressed_length : length;
+
+  length = 0;
+  point_count = 0;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+// Makes room for a point of point_length bytes, sending the batch first if it doesn't fit anymore, and starts the batch if it's empty
+// Returns false if the point is larger than the whole batch
+template <typename Transport, size_t capacity>
+bool PointBatch<Transport, capacity>::begin_point(size_t point_length)
+{
+  // Json: "[" + point + "]", with a "," between points, the closing bracket's space also holds the null-terminator written by serializeJson
+  // Binary: the message header before the first point, one spare byte for the null-terminator written by serializeJson
+  const size_t start_length = wire_format == WireFormat::json ? 1 : binary_message_header_size;
+  const size_t separator_length = wire_format == WireFormat::json ? 1 : 0;
+  if (start_length + point_length + 1 > max_size)
+    return false;
+
+  if (point_count > 0 && length + separator_length + point_length + 1 > max_size)
+    flush();
+
+  if (point_count == 0)
+  {
+    if (wire_format == WireFormat::json)
+      buffer[0] = '[';
+    else
+      write_binary_message_header((uint8_t *)buffer);
+    length = start_length;
+    first_point_timestamp_msecs = millis();
+  }
+  else if (separator_length > 0)
+  {
+    buffer[length++] = ',';
+  }
+  return true;
+}
+
+// Sends a message, and keeps it in case the collector rejects it (message may be the kept message itself)
+// Returns false if the transport couldn't send it
+template <typename Transport, size_t capacity>
+bool PointBatch<Transport, capacity>::send_message(const char *message, size_t message_length, ContentEncoding encoding)
+{
+  const bool is_sent = transport.send_data_point(message, message_length, encoding);
+  if constexpr (!keeps_sent_message)
+  {
+    dropped_messages += !is_sent;
+  }
+  else
+  {
+    if (message != sent_message)
+      memcpy(sent_message, message, message_length);
+    sent_message_length = message_length;
+    sent_message_encoding = encoding;
+    sent_message_request_number = is_sent ? transport.get_last_request_number() : 0;
+    sent_message_timestamp_msecs = millis();
+  }
+  return is_sent;
+}
+
+// Whether the kept message is still waiting for the collector's response or has to be sent again
+// Forgets it once the collector took it
+template <typename Transport, size_t capacity>
+typename PointBatch<Transport, capacity>::SentMessageState PointBatch<Transport, capacity>::check_sent_message()
+{
+  if constexpr (keeps_sent_message)
+  {
+    if (sent_message_length == 0)
+      return SentMessageState::none;
+    if (sent_message_request_number == 0)
+      return SentMessageState::needs_resend;
+    switch (transport.get_request_outcome(sent_message_request_number))
+    {
+    case RequestOutcome::pending:
+      return SentMessageState::awaiting_response;
+    case RequestOutcome::accepted:
+      sent_message_length = 0;
+      return SentMessageState::none;
+    default:
+      return SentMessageState::needs_resend;
+    }
+  }
+  return SentMessageState::none;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <ArduinoJson.h>
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Tags and fields that (almost) never change, like meter ids, sent to the collector once instead of with every data point.
+ * Data points then only carry {"descriptor": <id>}, the collector adds the descriptor's tags and fields back before writing them,
+ * so what ends up in influxdb is the same. See the project readme file for the message format.
+ *
+ * The id is a hash of the content, so changed content gets a new id (and is registered again) and ids of different devices don't clash.
+ * The descriptor is also registered again after every reconnect of the transport, and every refresh_interval_msecs,
+ * for collectors that restarted without the device noticing (mqtt, udp) and registrations in lost udp datagrams.
+ */
+class PointDescriptor
+{
+public:
+  PointDescriptor(const uint32_t refresh_interval_msecs);
+
+  /*
+   * descriptor_json holds the descriptor's "tags" and "fields" objects, built again before every data point that uses it.
+   * Returns the id to put in the data point. If needed, descriptor_json gets a "register_descriptor" id
+   * and is added to batch (before the data point, so the collector knows it in time).
+   */
+  template <typename TJsonDocument, typename Batch>
+  uint32_t register_if_needed(TJsonDocument &descriptor_json, Batch &batch, const uint32_t server_connect_count);
+
+private:
+  // Hashes everything printed to it (FNV-1a), so the content doesn't need to be buffered
+  class HashPrint : public Print
+  {
+  public:
+    size_t write(uint8_t c) override
+    {
+      hash = (hash ^ c) * 16777619u;
+      return 1;
+    }
+
+    uint32_t hash = 2166136261u;
+  };
+
+private:
+  const uint32_t refresh_interval_msecs;
+
+  bool is_registered = false;
+  uint32_t registered_id = 0;
+  uint32_t registered_server_connect_count = 0;
+  uint32_t registered_timestamp_msecs = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+PointDescriptor::PointDescriptor(const uint32_t refresh_interval_msecs)
+    : refresh_interval_msecs(refresh_interval_msecs)
+{
+}
+
+template <typename TJsonDocument, typename Batch>
+uint32_t PointDescriptor::register_if_needed(TJsonDocument &descriptor_json, Batch &batch, const uint32_t server_connect_count)
+{
+  HashPrint hash_print;
+  serializeJson(descriptor_json, hash_print);
+  const uint32_t id = hash_print.hash;
+
+  const uint32_t curr_timestamp_msecs = millis();
+  if (is_registered && id == registered_id && server_connect_count == registered_server_connect_count &&
+      curr_timestamp_msecs - registered_timestamp_msecs < refresh_interval_msecs)
+    return id;
+
+  descriptor_json["register_descriptor"] = id;
+  if (!batch.add(descriptor_json))
+    return id; // Too large to ever send, the collector will drop the data points
+
+  is_registered = true;
+  registered_id = id;
+  registered_server_connect_count = server_connect_count;
+  registered_timestamp_msecs = curr_timestamp_msecs;
+  return id;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <string.h>
+#include <ArduinoJson.h>
+#ifdef ESP32
+#include <Preferences.h> // ESP32 NVS
+#endif
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// Describes one member of a RuntimeConfig's Values struct
+template <typename Values>
+struct RuntimeSettingDescriptor
+{
+  const char *name; // Key in the config json
+  uint32_t Values::*member;
+  uint32_t min_value;
+  uint32_t max_value;
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Settings that can be changed at runtime, without reflashing, from a json object like {"heartbeat_interval_msecs": 60000}.
+ * The sketch receives it on a retained mqtt topic (so it is delivered again on every reconnect) and hands it to apply_json(...).
+ *
+ * Values is a struct of uint32_t members, its default member values (taken from settings.h) are the fallback:
+ *   - The config json holds all overrides, a key that is left out goes back to its default
+ *   - A config is applied completely or not at all: every key must be known and every value an integer in range
+ *   - Applied values are stored in NVS (esp32 only) and loaded by init(), so they also hold while the broker is unreachable
+ * Readers simply use get().some_member every time, so changes take effect immediately.
+ */
+template <typename Values, size_t count>
+class RuntimeConfig
+{
+public:
+  static constexpr size_t json_capacity = JSON_OBJECT_SIZE(count + 4) + (count + 4) * 48; // A few unknown keys still parse, and are reported
+
+  RuntimeConfig(const RuntimeSettingDescriptor<Values> (&descriptors)[count], const char *nvs_namespace);
+
+  // Loads the values stored in NVS, if they are still valid for the current Values layout
+  void init();
+
+  const Values &get() const { return values; }
+
+  // Returns false, and leaves every value unchanged, if the config is invalid
+  // error is set to a static description of the problem on failure
+  bool apply_json(const char *payload, size_t length, const char **error);
+
+  // {"settings": {<every active value>}, "error": "..."}, error only if not nullptr
+  void serialize_active(String &json_string, const char *error) const;
+
+private:
+  bool is_valid(const Values &candidate) const;
+  uint32_t layout_hash() const;
+
+private:
+  const RuntimeSettingDescriptor<Values> (&descriptors)[count];
+  Values values;
+
+#ifdef ESP32
+  const char *nvs_namespace;
+  Preferences preferences;
+#endif
+};
+
+// Deduces count from the descriptor array
+template <typename Values, size_t count>
+RuntimeConfig(const RuntimeSettingDescriptor<Values> (&)[count], const char *) -> RuntimeConfig<Values, count>;
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Values, size_t count>
+RuntimeConfig<Values, count>::RuntimeConfig(const RuntimeSettingDescriptor<Values> (&descriptors)[count], const char *nvs_namespace)
+    : descriptors(descriptors)
+#ifdef ESP32
+      ,
+      nvs_namespace(nvs_namespace)
+#endif
+{
+}
+
+template <typename Values, size_t count>
+void RuntimeConfig<Values, count>::init()
+{
+#ifdef ESP32
+  preferences.begin(nvs_namespace, false);
+
+  Values stored_values;
+  if (preferences.getUInt("layout", 0) == layout_hash() &&
+      preferences.getBytes("values", &stored_values, sizeof(stored_values)) == sizeof(stored_values) &&
+      is_valid(stored_values))
+  {
+    values = stored_values;
+  }
+#endif
+}
+
+template <typename Values, size_t count>
+bool RuntimeConfig<Values, count>::apply_json(const char *payload, size_t length, const char **error)
+{
+  StaticJsonDocument<json_capacity> json; // Gets destroyed when leaving this scope
+  if (deserializeJson(json, payload, length) != DeserializationError::Ok || !json.template is<JsonObjectConst>())
+  {
+    *error = "Config is not a json object";
+    return false;
+  }
+
+  Values candidate = Values(); // Defaults for every key that is left out
+  for (JsonPairConst pair : json.template as<JsonObjectConst>())
+  {
+    const RuntimeSettingDescriptor<Values> *descriptor = nullptr;
+    for (const RuntimeSettingDescriptor<Values> &current_descriptor : descriptors)
+      if (strcmp(current_descriptor.name, pair.key().c_str()) == 0)
+        descriptor = &current_descriptor;
+
+    if (descriptor == nullptr)
+    {
+      *error = "Config has an unknown setting";
+      return false;
+    }
+    if (!pair.value().template is<uint32_t>())
+    {
+      *error = "Config has a setting that is not a positive integer";
+      return false;
+    }
+    candidate.*(descriptor->member) = pair.value().template as<uint32_t>();
+  }
+
+  if (!is_valid(candidate))
+  {
+    *error = "Config has a setting that is out of range";
+    return false;
+  }
+
+  const bool is_changed = memcmp(&candidate, &values, sizeof(Values)) != 0;
+  values = candidate;
+
+#ifdef ESP32
+  // Retained configs are delivered again on every reconnect, only write flash when something changed
+  if (is_changed)
+  {
+    preferences.putUInt("layout", layout_hash());
+    preferences.putBytes("values", &values, sizeof(values));
+  }
+#endif
+  return true;
+}
+
+template <typename Values, size_t count>
+void RuntimeConfig<Values, count>::serialize_active(String &json_string, const char *error) const
+{
+  StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(count)> json; // Gets destroyed when leaving this scope
+
+  // Names and error are static strings, stored as pointers
+  JsonObject settings_json = json.createNestedObject("settings");
+  for (const RuntimeSettingDescriptor<Values> &descriptor : descriptors)
+    settings_json[descriptor.name] = values.*(descriptor.member);
+  if (error != nullptr)
+    json["error"] = error;
+
+  serializeJson(json, json_string);
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+template <typename Values, size_t count>
+bool RuntimeConfig<Values, count>::is_valid(const Values &candidate) const
+{
+  for (const RuntimeSettingDescriptor<Values> &descriptor : descriptors)
+  {
+    const uint32_t value = candidate.*(descriptor.member);
+    if (value < descriptor.min_value || value > descriptor.max_value)
+      return false;
+  }
+  return true;
+}
+
+// Changes when settings are added, removed or renamed, so values stored by an older sketch are not misread
+template <typename Values, size_t count>
+uint32_t RuntimeConfig<Values, count>::layout_hash() const
+{
+  uint32_t hash = 2166136261u ^ sizeof(Values); // FNV-1a
+  for (const RuntimeSettingDescriptor<Values> &descriptor : descriptors)
+  {
+    for (const char *c = descriptor.name; *c != '\0'; c++)
+    {
+      hash ^= (uint8_t)*c;
+      hash *= 16777619u;
+    }
+  }
+  return hash;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <stdint.h>
+#include <tuple>
+#include <utility>
+
+#include "point_batch.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// CPU time spent in sample() and encode() of one sensor, sending is not included
+struct SensorStats
+{
+  uint32_t runs = 0;
+  uint32_t total_micros = 0;
+  uint32_t max_micros = 0;
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Runs a set of sensors that is fixed at compile time, each at its own cadence, and batches their data points.
+ *
+ * A sensor is a default-constructible type like:
+ *   struct WaterDepthSensor
+ *   {
+ *     static constexpr const char *name = "water_depth"; // Used in the stats
+ *     uint32_t interval_msecs() const;                  // Cadence of sample(), 0 = every run()
+ *     bool sample();                                    // Reads the hardware, returns true if there is something to encode
+ *     void encode(Batch &batch);                        // Adds the data points of the last sample to the batch
+ *   };
+ * sample() may also just act on its readings (e.g. draw a display) and return false.
+ *
+ * The sensors live in a std::tuple and run() expands to a straight sequence of calls on them:
+ * no virtual calls, no function pointers, no heap. Sensors are reachable with get<Sensor>().
+ */
+template <typename Transport, size_t batch_capacity, typename... Sensors>
+class SensorEngine
+{
+public:
+  using Batch = PointBatch<Transport, batch_capacity>;
+  static constexpr size_t sensor_count = sizeof...(Sensors);
+
+  SensorEngine(Transport &transport, const uint32_t max_batch_delay_msecs);
+
+  // Call on every loop(), runs the sensors that are due and sends the batch when it is due
+  void run();
+
+  template <typename Sensor>
+  Sensor &get() { return std::get<Sensor>(sensors); }
+
+  // Calls func(const char *name, const SensorStats &stats) for every sensor
+  template <typename Function>
+  void for_each_stats(Function func) const { for_each_stats(func, std::index_sequence_for<Sensors...>()); }
+  void reset_stats();
+
+  Batch &get_batch() { return batch; }
+
+private:
+  template <size_t... indices>
+  void run_all(std::index_sequence<indices...>) { (run_sensor<indices>(), ...); }
+
+  template <size_t index>
+  void run_sensor();
+
+  template <typename Function, size_t... indices>
+  void for_each_stats(Function func, std::index_sequence<indices...>) const
+  {
+    (func(std::tuple_element_t<indices, std::tuple<Sensors...>>::name, stats[indices]), ...);
+  }
+
+private:
+  std::tuple<Sensors...> sensors;
+  Batch batch;
+
+  uint32_t last_run_timestamps_msecs[sensor_count] = {};
+  SensorStats stats[sensor_count];
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Transport, size_t batch_capacity, typename... Sensors>
+SensorEngine<Transport, batch_capacity, Sensors...>::SensorEngine(Transport &transport, const uint32_t max_batch_delay_msecs)
+    : batch(transport, max_batch_delay_msecs)
+{
+}
+
+template <typename Transport, size_t batch_capacity, typename... Sensors>
+void SensorEngine<Transport, batch_capacity, Sensors...>::run()
+{
+  run_all(std::index_sequence_for<Sensors...>());
+  batch.flush_if_due();
+}
+
+template <typename Transport, size_t batch_capacity, typename... Sensors>
+void SensorEngine<Transport, batch_capacity, Sensors...>::reset_stats()
+{
+  for (SensorStats &sensor_stats : stats)
+    sensor_stats = SensorStats();
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+template <typename Transport, size_t batch_capacity, typename... Sensors>
+template <size_t index>
+void SensorEngine<Transport, batch_capacity, Sensors...>::run_sensor()
+{
+  auto &sensor = std::get<index>(sensors);
+
+  // Same timing as run_in_interval_nonblocking
+  const uint32_t interval_msecs = sensor.interval_msecs();
+  if (interval_msecs > 0)
+  {
+    uint32_t &last_run_timestamp_msecs = last_run_timestamps_msecs[index];
+    const uint32_t curr_timestamp_msecs = millis();
+    if (curr_timestamp_msecs < last_run_timestamp_msecs) // Detect millis() overflow
+      last_run_timestamp_msecs = 0;
+    if (curr_timestamp_msecs - last_run_timestamp_msecs < interval_msecs)
+      return;
+    last_run_timestamp_msecs = curr_timestamp_msecs;
+  }
+
+  const uint32_t start_micros = micros();
+  const uint32_t start_send_micros = batch.get_send_micros();
+
+  if (sensor.sample())
+    sensor.encode(batch);
+
+  // Encoding may have sent a full batch, that time is the transport's, not the sensor's
+  const uint32_t elapsed_micros = (micros() - start_micros) - (batch.get_send_micros() - start_send_micros);
+
+  SensorStats &sensor_stats = stats[index];
+  sensor_stats.runs++;
+  sensor_stats.total_micros += elapsed_micros;
+  if (elapsed_micros > sensor_stats.max_micros)
+    sensor_stats.max_micros = elapsed_micros;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <atomic>
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Hands the latest value of T from one writer to any number of readers on other tasks, without locks.
+ * The writer fills the buffer readers are not pointed at and then publishes it by bumping a version counter.
+ * A reader copies the published buffer and retries if a newer version was published in the meantime
+ * (a version counter, not the buffer index, so a reader can detect the writer having lapped it).
+ * The writer never waits for readers. Keep T trivially copyable and small.
+ */
+template <typename T>
+class DoubleBufferedSnapshot
+{
+public:
+  // Only call from a single task
+  void publish(const T &value);
+  // Returns false if nothing was published yet
+  bool read(T *out) const;
+
+private:
+  T buffers[2];
+  std::atomic<uint32_t> version{0}; // 0 = nothing published, otherwise buffers[version % 2] is the latest
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename T>
+void DoubleBufferedSnapshot<T>::publish(const T &value)
+{
+  const uint32_t next_version = version.load(std::memory_order_relaxed) + 1;
+  buffers[next_version % 2] = value;
+  version.store(next_version, std::memory_order_release);
+}
+
+template <typename T>
+bool DoubleBufferedSnapshot<T>::read(T *out) const
+{
+  while (true)
+  {
+    const uint32_t version_before = version.load(std::memory_order_acquire);
+    if (version_before == 0)
+      return false;
+
+    *out = buffers[version_before % 2];
+
+    // The writer only touches our buffer again for version_before + 2, but it may already have started
+    // right after publishing version_before + 1, so any newer version means the copy may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (version.load(std::memory_order_relaxed) == version_before)
+      return true;
+  }
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <string.h>
+
+#ifdef ESP8266
+#include <WiFiClientSecureBearSSL.h>
+#else
+#include <WiFiClient.h>
+#include <mbedtls/version.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#endif
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+struct TlsStats
+{
+  uint32_t full_handshakes = 0;
+  uint32_t resumed_handshakes = 0; // Abbreviated handshakes, using the session of the previous connection
+  uint32_t failed_handshakes = 0;
+  uint32_t last_handshake_micros = 0;
+  uint32_t total_handshake_micros = 0;
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * A tls 1.2 client socket that remembers the session of its last connection and offers it on the next connect,
+ * so a reconnect costs an abbreviated handshake (no certificate chain, no public key operations) instead of a full one.
+ *
+ *   - esp8266: BearSSL::WiFiClientSecure with a BearSSL::Session (session ids only, BearSSL has no ticket support)
+ *   - esp32: mbedtls on top of a plain WiFiClient, as the core's WiFiClientSecure can't resume sessions
+ *     (session ids and session tickets, whichever the server supports)
+ *
+ * Only has the methods the transports need, the names match those of WiFiClient.
+ */
+class TlsSocket
+{
+public:
+  TlsSocket() = default;
+  TlsSocket(const TlsSocket &) = delete;
+  ~TlsSocket();
+
+  // PEM certificate(s) to verify the server with, call before the first connect
+  // Without one the server is not verified (only ok on a trusted network)
+  void set_ca_cert(const char *ca_cert_pem) { this->ca_cert_pem = ca_cert_pem; }
+
+  bool connect(const char *host, uint16_t port);
+  bool connected();
+  void stop();
+  int available();
+  int read(uint8_t *buffer, size_t size);
+  int read();
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t print(const String &str) { return write((const uint8_t *)str.c_str(), str.length()); }
+  void setNoDelay(bool no_delay);
+
+  const TlsStats &get_stats() const { return stats; }
+  bool was_last_handshake_resumed() const { return is_last_handshake_resumed; }
+
+private:
+  void count_handshake(bool success, uint32_t start_micros);
+
+private:
+  const char *ca_cert_pem = nullptr;
+  TlsStats stats;
+  bool is_last_handshake_resumed = false;
+
+#ifdef ESP8266
+  BearSSL::WiFiClientSecure tls_client;
+  BearSSL::Session session;
+  BearSSL::X509List trust_anchors;
+  bool is_configured = false;
+#else
+  bool init_mbedtls();
+  bool handshake(const char *host);
+  static int send_callback(void *context, const unsigned char *buffer, size_t length);
+  static int recv_callback(void *context, unsigned char *buffer, size_t length);
+
+  static constexpr uint32_t handshake_timeout_msecs = 10000;
+  static constexpr uint32_t handshake_poll_msecs = 5; // Between checks for the server's next handshake message
+
+  WiFiClient tcp_client;
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_config config;
+  mbedtls_entropy_context entropy;
+  mbedtls_ctr_drbg_context ctr_drbg;
+  mbedtls_x509_crt ca_cert;
+  mbedtls_ssl_session session;
+  bool is_mbedtls_initialized = false;
+  bool has_session = false;
+  bool is_open = false;
+#endif
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+#ifdef ESP8266
+
+TlsSocket::~TlsSocket()
+{
+}
+
+bool TlsSocket::connect(const char *host, uint16_t port)
+{
+  if (!is_configured)
+  {
+    if (ca_cert_pem != nullptr)
+    {
+      trust_anchors.append(ca_cert_pem);
+      tls_client.setTrustAnchors(&trust_anchors);
+    }
+    else
+    {
+      tls_client.setInsecure();
+    }
+    tls_client.setSession(&session); // Updated after every handshake, offered on every connect
+    is_configured = true;
+  }
+
+  // The server echoes the offered session id when it resumes the session
+  uint8_t offered_session_id[32];
+  const size_t offered_session_id_length = session.getSession()->session_id_len;
+  memcpy(offered_session_id, session.getSession()->session_id, offered_session_id_length);
+
+  const uint32_t start_micros = micros();
+  const bool success = tls_client.connect(host, port);
+  is_last_handshake_resumed = success && offered_session_id_length > 0 &&
+                              session.getSession()->session_id_len == offered_session_id_length &&
+                              memcmp(session.getSession()->session_id, offered_session_id, offered_session_id_length) == 0;
+  count_handshake(success, start_micros);
+  return success;
+}
+
+bool TlsSocket::connected() { return tls_client.connected(); }
+void TlsSocket::stop() { tls_client.stop(); }
+int TlsSocket::available() { return tls_client.available(); }
+int TlsSocket::read(uint8_t *buffer, size_t size) { return tls_client.read(buffer, size); }
+int TlsSocket::read() { return tls_client.read(); }
+size_t TlsSocket::write(const uint8_t *buffer, size_t size) { return tls_client.write(buffer, size); }
+void TlsSocket::setNoDelay(bool no_delay) { tls_client.setNoDelay(no_delay); }
+
+#else
+
+TlsSocket::~TlsSocket()
+{
+  if (!is_mbedtls_initialized)
+    return;
+  mbedtls_ssl_session_free(&session);
+  mbedtls_ssl_free(&ssl);
+  mbedtls_ssl_config_free(&config);
+  mbedtls_x509_crt_free(&ca_cert);
+  mbedtls_ctr_drbg_free(&ctr_drbg);
+  mbedtls_entropy_free(&entropy);
+}
+
+bool TlsSocket::connect(const char *host, uint16_t port)
+{
+  stop();
+  if (!is_mbedtls_initialized && !init_mbedtls())
+    return false;
+  if (!tcp_client.connect(host, port))
+    return false;
+
+  const uint32_t start_micros = micros();
+  const bool success = handshake(host);
+  count_handshake(success, start_micros);
+  if (!success)
+  {
+    tcp_client.stop();
+    return false;
+  }
+
+  is_open = true;
+  return true;
+}
+
+bool TlsSocket::connected()
+{
+  return is_open && tcp_client.connected();
+}
+
+void TlsSocket::stop()
+{
+  if (is_open)
+  {
+    mbedtls_ssl_close_notify(&ssl);
+    is_open = false;
+  }
+  tcp_client.stop();
+}
+
+int TlsSocket::available()
+{
+  if (!is_open)
+    return 0;
+  // Processes a pending record, if any, without consuming application data
+  mbedtls_ssl_read(&ssl, nullptr, 0);
+  return mbedtls_ssl_get_bytes_avail(&ssl);
+}
+
+int TlsSocket::read(uint8_t *buffer, size_t size)
+{
+  if (!is_open)
+    return -1;
+  const int result = mbedtls_ssl_read(&ssl, buffer, size);
+  return result > 0 ? result : -1;
+}
+
+int TlsSocket::read()
+{
+  uint8_t value;
+  return read(&value, 1) == 1 ? value : -1;
+}
+
+size_t TlsSocket::write(const uint8_t *buffer, size_t size)
+{
+  if (!is_open)
+    return 0;
+
+  size_t written = 0;
+  while (written < size)
+  {
+    const int result = mbedtls_ssl_write(&ssl, buffer + written, size - written);
+    if (result > 0)
+      written += result;
+    else if (result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE)
+      break;
+  }
+  return written;
+}
+
+void TlsSocket::setNoDelay(bool no_delay)
+{
+  tcp_client.setNoDelay(no_delay);
+}
+
+#endif
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+void TlsSocket::count_handshake(bool success, uint32_t start_micros)
+{
+  if (!success)
+  {
+    stats.failed_handshakes++;
+    return;
+  }
+
+  stats.last_handshake_micros = micros() - start_micros;
+  stats.total_handshake_micros += stats.last_handshake_micros;
+  if (is_last_handshake_resumed)
+    stats.resumed_handshakes++;
+  else
+    stats.full_handshakes++;
+}
+
+#ifndef ESP8266
+
+// mbedtls 3 hides the handshake state, it is only read to tell resumed handshakes apart
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define TLS_SOCKET_SSL_FIELD(field) MBEDTLS_PRIVATE(field)
+#else
+#define TLS_SOCKET_SSL_FIELD(field) field
+#endif
+
+bool TlsSocket::init_mbedtls()
+{
+  mbedtls_ssl_init(&ssl);
+  mbedtls_ssl_config_init(&config);
+  mbedtls_entropy_init(&entropy);
+  mbedtls_ctr_drbg_init(&ctr_drbg);
+  mbedtls_x509_crt_init(&ca_cert);
+  mbedtls_ssl_session_init(&session);
+  is_mbedtls_initialized = true;
+
+  if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, nullptr, 0) != 0)
+    return false;
+  if (mbedtls_ssl_config_defaults(&config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+    return false;
+
+  if (ca_cert_pem != nullptr)
+  {
+    // The length includes the null-terminator, as mbedtls expects for PEM
+    if (mbedtls_x509_crt_parse(&ca_cert, (const unsigned char *)ca_cert_pem, strlen(ca_cert_pem) + 1) != 0)
+      return false;
+    mbedtls_ssl_conf_ca_chain(&config, &ca_cert, nullptr);
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_REQUIRED);
+  }
+  else
+  {
+    mbedtls_ssl_conf_authmode(&config, MBEDTLS_SSL_VERIFY_NONE);
+  }
+
+  mbedtls_ssl_conf_rng(&config, mbedtls_ctr_drbg_random, &ctr_drbg);
+#if MBEDTLS_VERSION_MAJOR >= 3
+  mbedtls_ssl_conf_max_tls_version(&config, MBEDTLS_SSL_VERSION_TLS1_2);
+#else
+  mbedtls_ssl_conf_max_version(&config, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3); // tls 1.2
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+  mbedtls_ssl_conf_session_tickets(&config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+  return mbedtls_ssl_setup(&ssl, &config) == 0;
+}
+
+bool TlsSocket::handshake(const char *host)
+{
+  is_last_handshake_resumed = false;
+
+  mbedtls_ssl_session_reset(&ssl);
+  if (mbedtls_ssl_set_hostname(&ssl, host) != 0)
+    return false;
+  mbedtls_ssl_set_bio(&ssl, &tcp_client, send_callback, recv_callback, nullptr);
+
+  if (has_session)
+    mbedtls_ssl_set_session(&ssl, &session);
+
+  // Steps through the handshake like mbedtls_ssl_handshake, to see which states it goes through:
+  // when the server resumes the offered session (by session id or ticket), the client never sends a key exchange
+  bool is_full_handshake = false;
+  const uint32_t start_msecs = millis();
+  while (ssl.TLS_SOCKET_SSL_FIELD(state) != MBEDTLS_SSL_HANDSHAKE_OVER)
+  {
+    if (ssl.TLS_SOCKET_SSL_FIELD(state) == MBEDTLS_SSL_CLIENT_KEY_EXCHANGE)
+      is_full_handshake = true;
+    const int result = mbedtls_ssl_handshake_step(&ssl);
+    if (result == 0)
+      continue;
+    if (result != MBEDTLS_ERR_SSL_WANT_READ && result != MBEDTLS_ERR_SSL_WANT_WRITE)
+      return false;
+
+    // Waits for the server's next message, delay lets the other tasks (and the wifi stack) run meanwhile
+    do
+    {
+      if (!tcp_client.connected() || millis() - start_msecs > handshake_timeout_msecs)
+        return false;
+      delay(handshake_poll_msecs);
+    } while (result == MBEDTLS_ERR_SSL_WANT_READ && tcp_client.available() <= 0);
+  }
+  is_last_handshake_resumed = !is_full_handshake;
+
+  mbedtls_ssl_session new_session;
+  mbedtls_ssl_session_init(&new_session);
+  if (mbedtls_ssl_get_session(&ssl, &new_session) != 0)
+  {
+    mbedtls_ssl_session_free(&new_session);
+    return true; // Connected all the same, the next connect just does a full handshake
+  }
+
+  mbedtls_ssl_session_free(&session);
+  session = new_session; // Takes over the ticket and peer certificate it owns
+  has_session = true;
+  return true;
+}
+
+int TlsSocket::send_callback(void *context, const unsigned char *buffer, size_t length)
+{
+  WiFiClient *tcp_client = (WiFiClient *)context;
+  const int written = tcp_client->write(buffer, length);
+  if (written > 0)
+    return written;
+  return tcp_client->connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+int TlsSocket::recv_callback(void *context, unsigned char *buffer, size_t length)
+{
+  WiFiClient *tcp_client = (WiFiClient *)context;
+  if (tcp_client->available() <= 0)
+    return tcp_client->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+  const int read = tcp_client->read(buffer, length);
+  return read > 0 ? read : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+#endif
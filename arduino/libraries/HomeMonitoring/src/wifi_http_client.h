@@ -0,0 +1,167 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <WiFiClient.h>
+#include "http_response_reader.h"
+#include "wifi_transport.h"
+
+///                    ///
+// Function definitions //
+///                    ///
+
+// Writes a keep-alive HTTP POST request to socket (a WiFiClient or a TlsSocket)
+template <typename Socket>
+void write_http_post(Socket &socket, const char *host, const String &path, const char *body, size_t body_length,
+                     ContentEncoding encoding = ContentEncoding::identity)
+{
+  String http_head;
+  http_head.reserve(128);
+
+  http_head += String(F("POST ")) + path + String(F(" HTTP/1.1\n"));
+
+  // Headers
+  http_head += String(F("Host: ")) + String(host) + String(F("\n"));
+  http_head += String(F("Connection: keep-alive\n"));
+  if (body_length > 0)
+    http_head += String("Content-Length: ") + String(body_length) + String(F("\n"));
+  if (encoding == ContentEncoding::gzip)
+    http_head += String(F("Content-Encoding: gzip\n"));
+  if (encoding == ContentEncoding::binary)
+    http_head += String(F("Content-Type: application/octet-stream\n"));
+  http_head += String(F("\n")); // Indicate end of headers with an empty line
+
+  // The body is written as-is instead of being copied behind the head, nodelay keeps the second segment from waiting
+  socket.print(http_head);
+  socket.write((const uint8_t *)body, body_length);
+}
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Very simple http client intended to send small amounts of data in intervals.
+ * Keeps the tcp connection open between requests. Requests don't wait for their response,
+ * responses are read on the next reconnect_if_needed() for the collector's Retry-After and for rejected requests
+ * (see HttpResponseReader).
+ */
+class WifiHttpClient : public WifiTransport<WifiHttpClient>
+{
+public: // Constants
+  static constexpr uint16_t default_port = 8080;
+  static constexpr const char *data_points_path = "/";
+  static constexpr const char *binary_data_points_path = "/binary";
+
+public: // Public methods
+  /*
+   * If use_serial is true, it is assumed that Serial.begin(...) is called in setup().
+   * The constructor does nothing but store its arguments.
+   */
+  WifiHttpClient(
+      const char *wifi_ssid, const char *wifi_pass,
+      const char *http_server_address, const uint16_t http_server_port = default_port,
+      const bool use_serial = false,
+      const uint32_t wifi_connected_check_delay_msecs = 1000, const uint32_t wifi_connected_check_times = 5,
+      const uint32_t http_retry_connect_delay_msecs = 8000);
+
+  void send_post(const String &path, const char *body, size_t body_length, ContentEncoding encoding = ContentEncoding::identity);
+  void send_post(const String &path, const String &body) { send_post(path, body.c_str(), body.length()); }
+
+  // How long the collector asks to wait between messages while it falls behind, 0 otherwise
+  // PointBatch waits at least this long before sending a batch
+  uint32_t get_requested_batch_delay_msecs() const { return response_reader.get_retry_after_msecs(); }
+  // The number of the last request sent (counted since boot) and what became of a request
+  // PointBatch sends a batch again if the collector rejected it
+  uint32_t get_last_request_number() const { return response_reader.get_sent_request_count(); }
+  RequestOutcome get_request_outcome(uint32_t request_number) const { return response_reader.get_request_outcome(request_number); }
+  const HttpResponseStats &get_response_stats() const { return response_reader.get_stats(); }
+
+private: // WifiTransport implementation
+  friend class WifiTransport<WifiHttpClient>;
+
+  bool connect_server();
+  bool is_server_connected();
+  void disconnect_server();
+  void poll_server();
+  bool send_data_point_impl(const char *message, size_t length, ContentEncoding encoding);
+
+private: // Attributes
+  WiFiClient tcp_client;
+  HttpResponseReader response_reader;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+WifiHttpClient::WifiHttpClient(
+    const char *wifi_ssid, const char *wifi_pass,
+    const char *http_server_address, const uint16_t http_server_port,
+    const bool use_serial,
+    const uint32_t wifi_connected_check_delay_msecs, const uint32_t wifi_connected_check_times,
+    const uint32_t http_retry_connect_delay_msecs)
+    : WifiTransport(
+          wifi_ssid, wifi_pass,
+          http_server_address, http_server_port,
+          use_serial,
+          wifi_connected_check_delay_msecs, wifi_connected_check_times,
+          http_retry_connect_delay_msecs)
+{
+}
+
+void WifiHttpClient::send_post(const String &path, const char *body, size_t body_length, ContentEncoding encoding)
+{
+  write_http_post(tcp_client, server_address, path, body, body_length, encoding);
+  response_reader.count_request();
+
+  if (use_serial)
+    Serial.println(F("Successfully sent HTTP POST"));
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+bool WifiHttpClient::connect_server()
+{
+  if (use_serial)
+  {
+    Serial.print(F("Connecting to http server at http://"));
+    Serial.print(server_address);
+    Serial.print(F(":"));
+    Serial.println(server_port);
+  }
+
+  if (!tcp_client.connect(server_address, server_port))
+    return false;
+  tcp_client.setNoDelay(true);
+
+  if (use_serial)
+    Serial.println(F("Successfully connected to the http server"));
+  return true;
+}
+
+bool WifiHttpClient::is_server_connected()
+{
+  return tcp_client.connected();
+}
+
+void WifiHttpClient::disconnect_server()
+{
+  tcp_client.stop();
+  response_reader.reset();
+}
+
+void WifiHttpClient::poll_server()
+{
+  response_reader.read_available(tcp_client);
+}
+
+bool WifiHttpClient::send_data_point_impl(const char *message, size_t length, ContentEncoding encoding)
+{
+  send_post(encoding == ContentEncoding::binary ? binary_data_points_path : data_points_path, message, length, encoding);
+  return true;
+}
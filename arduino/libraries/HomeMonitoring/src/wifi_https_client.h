@@ -0,0 +1,149 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include "tls_socket.h"
+#include "wifi_http_client.h"
+#include "wifi_transport.h"
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * WifiHttpClient over tls, for collectors that are reached across the internet.
+ * Keeps the connection open between requests like WifiHttpClient, and resumes the previous tls session
+ * when it has to reconnect, which skips the expensive part of the handshake.
+ * Call set_ca_cert(...) before first_connect() to verify the collector, see TlsSocket.
+ */
+class WifiHttpsClient : public WifiTransport<WifiHttpsClient>
+{
+public: // Constants
+  static constexpr uint16_t default_port = 8443;
+
+public: // Public methods
+  /*
+   * If use_serial is true, it is assumed that Serial.begin(...) is called in setup().
+   * The constructor does nothing but store its arguments.
+   */
+  WifiHttpsClient(
+      const char *wifi_ssid, const char *wifi_pass,
+      const char *https_server_address, const uint16_t https_server_port = default_port,
+      const bool use_serial = false,
+      const uint32_t wifi_connected_check_delay_msecs = 1000, const uint32_t wifi_connected_check_times = 5,
+      const uint32_t https_retry_connect_delay_msecs = 8000);
+
+  void set_ca_cert(const char *ca_cert_pem) { tls_socket.set_ca_cert(ca_cert_pem); }
+
+  void send_post(const String &path, const char *body, size_t body_length, ContentEncoding encoding = ContentEncoding::identity);
+  void send_post(const String &path, const String &body) { send_post(path, body.c_str(), body.length()); }
+
+  // Handshake counts and times since boot
+  const TlsStats &get_tls_stats() const { return tls_socket.get_stats(); }
+  // See WifiHttpClient
+  uint32_t get_requested_batch_delay_msecs() const { return response_reader.get_retry_after_msecs(); }
+  uint32_t get_last_request_number() const { return response_reader.get_sent_request_count(); }
+  RequestOutcome get_request_outcome(uint32_t request_number) const { return response_reader.get_request_outcome(request_number); }
+  const HttpResponseStats &get_response_stats() const { return response_reader.get_stats(); }
+
+private: // WifiTransport implementation
+  friend class WifiTransport<WifiHttpsClient>;
+
+  bool connect_server();
+  bool is_server_connected();
+  void disconnect_server();
+  void poll_server();
+  bool send_data_point_impl(const char *message, size_t length, ContentEncoding encoding);
+
+private: // Attributes
+  TlsSocket tls_socket;
+  HttpResponseReader response_reader;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+WifiHttpsClient::WifiHttpsClient(
+    const char *wifi_ssid, const char *wifi_pass,
+    const char *https_server_address, const uint16_t https_server_port,
+    const bool use_serial,
+    const uint32_t wifi_connected_check_delay_msecs, const uint32_t wifi_connected_check_times,
+    const uint32_t https_retry_connect_delay_msecs)
+    : WifiTransport(
+          wifi_ssid, wifi_pass,
+          https_server_address, https_server_port,
+          use_serial,
+          wifi_connected_check_delay_msecs, wifi_connected_check_times,
+          https_retry_connect_delay_msecs)
+{
+}
+
+void WifiHttpsClient::send_post(const String &path, const char *body, size_t body_length, ContentEncoding encoding)
+{
+  write_http_post(tls_socket, server_address, path, body, body_length, encoding);
+  response_reader.count_request();
+
+  if (use_serial)
+    Serial.println(F("Successfully sent HTTPS POST"));
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+bool WifiHttpsClient::connect_server()
+{
+  if (use_serial)
+  {
+    Serial.print(F("Connecting to https server at https://"));
+    Serial.print(server_address);
+    Serial.print(F(":"));
+    Serial.println(server_port);
+  }
+
+  if (!tls_socket.connect(server_address, server_port))
+    return false;
+  tls_socket.setNoDelay(true);
+
+  if (use_serial)
+  {
+    const TlsStats &stats = tls_socket.get_stats();
+    Serial.print(F("Successfully connected to the https server, "));
+    Serial.print(tls_socket.was_last_handshake_resumed() ? F("resumed") : F("full"));
+    Serial.print(F(" handshake took "));
+    Serial.print(stats.last_handshake_micros / 1000);
+    Serial.print(F(" ms ("));
+    Serial.print(stats.full_handshakes);
+    Serial.print(F(" full, "));
+    Serial.print(stats.resumed_handshakes);
+    Serial.print(F(" resumed, "));
+    Serial.print(stats.failed_handshakes);
+    Serial.println(F(" failed so far)"));
+  }
+  return true;
+}
+
+bool WifiHttpsClient::is_server_connected()
+{
+  return tls_socket.connected();
+}
+
+void WifiHttpsClient::disconnect_server()
+{
+  tls_socket.stop();
+  response_reader.reset();
+}
+
+void WifiHttpsClient::poll_server()
+{
+  response_reader.read_available(tls_socket);
+}
+
+bool WifiHttpsClient::send_data_point_impl(const char *message, size_t length, ContentEncoding encoding)
+{
+  send_post(encoding == ContentEncoding::binary ? WifiHttpClient::binary_data_points_path : WifiHttpClient::data_points_path, message, length, encoding);
+  return true;
+}
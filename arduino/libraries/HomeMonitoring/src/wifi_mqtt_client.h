@@ -0,0 +1,240 @@
+#pragma once
+
+// Install dependencies with:
+//   - Install ArduinoMqttClient through the library manager
+
+///        ///
+// Includes //
+///        ///
+
+#include <WiFiClient.h>
+#include <ArduinoMqttClient.h>
+#include "wifi_transport.h"
+
+///                     ///
+// Callback declarations //
+///                     ///
+
+// Signature dictated by MqttClient::onMessage
+void on_mqtt_message_internal_callback(int message_size);
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Mqtt client for publishing data points and receiving messages on subscribed topics.
+ * Several instances can be used at once (e.g. one per broker): MqttClient only calls back from within its own
+ * poll (also done while connecting and subscribing), so every method that may poll first marks its instance as the one to call back to.
+ */
+class WifiMqttClient : public WifiTransport<WifiMqttClient>
+{
+public: // Constants
+  static constexpr uint16_t default_port = 1883;
+  static constexpr const char *data_points_topic = "data-points";
+  static constexpr const char *gzip_data_points_topic = "data-points/gzip"; // Mqtt 3.1.1 has no content type property
+  static constexpr const char *binary_data_points_topic = "data-points/binary";
+  static constexpr uint8_t max_subscriptions = 4;
+
+public: // Public methods
+  /*
+   * If use_serial is true, it is assumed that Serial.begin(...) is called in setup().
+   * The constructor does nothing but store its arguments.
+   */
+  WifiMqttClient(
+      const char *wifi_ssid, const char *wifi_pass,
+      const char *mqtt_broker_address, const uint16_t mqtt_broker_port = default_port,
+      const bool use_serial = false,
+      const uint32_t incoming_message_size_limit = 256,
+      const uint32_t wifi_connected_check_delay_msecs = 1000, const uint32_t wifi_connected_check_times = 5,
+      const uint32_t mqtt_retry_connect_delay_msecs = 8000);
+
+  // Retained messages are kept by the broker and delivered to every new subscriber
+  void publish(const String &topic, const char *message, size_t length, bool retain = false);
+  void publish(const String &topic, const String &message, bool retain = false) { publish(topic, message.c_str(), message.length(), retain); }
+
+  bool is_on_message_set() const;
+  void set_on_message(void (*func)(String &topic, String &message));
+  // Subscriptions are restored after every reconnect
+  void subscribe(const String &topic);
+  void process_incoming_messages();
+  // Larger messages are skipped
+  void set_incoming_message_size_limit(uint32_t limit) { incoming_message_size_limit = limit; }
+
+private: // WifiTransport implementation
+  friend class WifiTransport<WifiMqttClient>;
+
+  bool connect_server();
+  bool is_server_connected();
+  void disconnect_server();
+  void poll_server();
+  bool send_data_point_impl(const char *message, size_t length, ContentEncoding encoding);
+
+private: // Attributes
+  uint32_t incoming_message_size_limit;
+
+  WiFiClient wifi_client;
+  MqttClient mqtt_client = MqttClient(wifi_client);
+
+  String subscriptions[max_subscriptions];
+  uint8_t subscription_count = 0;
+
+  void (*on_message)(String &topic, String &message) = nullptr;
+
+  static WifiMqttClient *polling_instance; // The instance whose MqttClient is polling
+
+  // Friends
+  friend void on_mqtt_message_internal_callback(int message_size);
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+WifiMqttClient::WifiMqttClient(
+    const char *wifi_ssid, const char *wifi_pass,
+    const char *mqtt_broker_address, const uint16_t mqtt_broker_port,
+    const bool use_serial,
+    const uint32_t incoming_message_size_limit,
+    const uint32_t wifi_connected_check_delay_msecs, const uint32_t wifi_connected_check_times,
+    const uint32_t mqtt_retry_connect_delay_msecs)
+    : WifiTransport(
+          wifi_ssid, wifi_pass,
+          mqtt_broker_address, mqtt_broker_port,
+          use_serial,
+          wifi_connected_check_delay_msecs, wifi_connected_check_times,
+          mqtt_retry_connect_delay_msecs),
+      incoming_message_size_limit(incoming_message_size_limit)
+{
+}
+
+void WifiMqttClient::publish(const String &topic, const char *message, size_t length, bool retain)
+{
+  mqtt_client.beginMessage(topic, (unsigned long)length, retain); // Streams the payload, the unsized variant truncates it to its tx buffer
+  mqtt_client.write((const uint8_t *)message, length);
+  mqtt_client.endMessage();
+
+  if (use_serial)
+    Serial.println(F("Successfully published message"));
+}
+
+bool WifiMqttClient::is_on_message_set() const
+{
+  return on_message != nullptr;
+}
+
+void WifiMqttClient::set_on_message(void (*func)(String &topic, String &message))
+{
+  on_message = func;
+}
+
+void WifiMqttClient::subscribe(const String &topic)
+{
+  assert(subscription_count < max_subscriptions);
+  subscriptions[subscription_count++] = topic;
+
+  polling_instance = this; // Retained messages may arrive while waiting for the subscription to be acknowledged
+  if (mqtt_client.connected())
+    mqtt_client.subscribe(topic);
+}
+
+void WifiMqttClient::process_incoming_messages()
+{
+  polling_instance = this;
+  mqtt_client.poll();
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+bool WifiMqttClient::connect_server()
+{
+  if (use_serial)
+  {
+    Serial.print(F("Connecting to mqtt broker at mqtt://"));
+    Serial.print(server_address);
+    Serial.print(F(":"));
+    Serial.println(server_port);
+  }
+
+  if (!mqtt_client.connect(server_address, server_port))
+  {
+    if (use_serial)
+    {
+      Serial.print(F("Mqtt connect error code: "));
+      Serial.println(mqtt_client.connectError());
+    }
+    return false;
+  }
+
+  mqtt_client.onMessage(on_mqtt_message_internal_callback);
+  polling_instance = this; // Retained messages may arrive while waiting for the subscriptions to be acknowledged
+  for (uint8_t i = 0; i < subscription_count; i++)
+    mqtt_client.subscribe(subscriptions[i]);
+
+  if (use_serial)
+    Serial.println(F("Successfully connected to the mqtt broker"));
+  return true;
+}
+
+bool WifiMqttClient::is_server_connected()
+{
+  return mqtt_client.connected();
+}
+
+void WifiMqttClient::disconnect_server()
+{
+  mqtt_client.stop();
+}
+
+void WifiMqttClient::poll_server()
+{
+  // Incoming messages are handled in process_incoming_messages(), so the sketch decides when callbacks run
+}
+
+bool WifiMqttClient::send_data_point_impl(const char *message, size_t length, ContentEncoding encoding)
+{
+  const char *topic = encoding == ContentEncoding::gzip ? gzip_data_points_topic : encoding == ContentEncoding::binary ? binary_data_points_topic : data_points_topic;
+  publish(topic, message, length);
+  return true;
+}
+
+///                                  ///
+// Static class attribute definitions //
+///                                  ///
+
+WifiMqttClient *WifiMqttClient::polling_instance = nullptr;
+
+///         ///
+// Callbacks //
+///         ///
+
+void on_mqtt_message_internal_callback(int message_size)
+{
+  WifiMqttClient *instance = WifiMqttClient::polling_instance;
+
+  if ((uint32_t)message_size >= instance->incoming_message_size_limit)
+  {
+    if (instance->use_serial)
+      Serial.println(F("Received mqtt message is too large, skipping"));
+    return;
+  }
+
+  if (instance->on_message == nullptr)
+    return;
+
+  String topic = instance->mqtt_client.messageTopic();
+
+  String message = "";
+  message.reserve(message_size);
+  ubyte buffer[17];
+  while (instance->mqtt_client.available())
+  {
+    memset(buffer, 0, 17);
+    instance->mqtt_client.read((uint8_t *)buffer, 16);
+    message += (char *)buffer;
+  }
+
+  instance->on_message(topic, message);
+}
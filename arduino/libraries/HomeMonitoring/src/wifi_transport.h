@@ -0,0 +1,223 @@
+#pragma once
+
+// Install dependencies with:
+//   - Set additional board manager urls in settings to:
+//       https://arduino.esp8266.com/stable/package_esp8266com_index.json
+//       https://raw.githubusercontent.com/espressif/arduino-esp32/gh-pages/package_esp32_index.json
+//   - Install esp8266 boards through the board manager (contains a good WiFiClient.h for arduinos)
+//   - Set the sketchbook location (File -> Preferences) to the "arduino" folder of this repository,
+//     so this library is found in "arduino/libraries"
+
+///        ///
+// Includes //
+///        ///
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#else
+#include <WiFi.h> // Works for arduino, esp32...
+#endif
+#include "home_monitoring_util.h"
+
+///                   ///
+// Struct declarations //
+///                   ///
+
+// How a message to the collector is encoded, the collector decodes gzip and binary messages before processing
+enum class ContentEncoding : uint8_t
+{
+  identity, // Plain json
+  gzip,
+  binary, // A binary message (binary_point.h), sent to its own http path or mqtt topic
+};
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Shared wifi and connection handling of the transports to the home-monitoring collector.
+ * Uses CRTP instead of virtual methods: the transport is picked at compile time and every call is resolved statically.
+ *
+ * Derived must implement (and may keep private, by befriending WifiTransport<Derived>):
+ *   - bool connect_server(): Opens the connection to the server, returns false on failure
+ *   - bool is_server_connected(): Returns true if the connection is (still) usable
+ *   - void disconnect_server(): Closes the connection
+ *   - void poll_server(): Handles incoming data, called on every reconnect_if_needed()
+ *   - bool send_data_point_impl(const char *message, size_t length, ContentEncoding encoding): Sends a message to the collector
+ *
+ * None of the methods block for long: failed (re)connects are retried on a later call,
+ * at most once every server_retry_connect_delay_msecs.
+ */
+template <typename Derived>
+class WifiTransport
+{
+public: // Public methods
+  /*
+   * If use_serial is true, it is assumed that Serial.begin(...) is called in setup().
+   * The constructor does nothing but store its arguments.
+   */
+  WifiTransport(
+      const char *wifi_ssid, const char *wifi_pass,
+      const char *server_address, const uint16_t server_port,
+      const bool use_serial,
+      const uint32_t wifi_connected_check_delay_msecs, const uint32_t wifi_connected_check_times,
+      const uint32_t server_retry_connect_delay_msecs);
+
+  void first_connect();
+  void reconnect_if_needed();
+
+  // Sends a message (one data point or a json array of them) to the collector, see the project readme file for the format
+  bool send_data_point(const char *message, size_t length, ContentEncoding encoding = ContentEncoding::identity);
+  bool send_data_point(const String &message) { return send_data_point(message.c_str(), message.length()); }
+
+  // Successful server connects since boot, a change means the server may have lost state it had about this device
+  uint32_t get_server_connect_count() const { return server_connect_count; }
+
+protected: // Protected methods
+  bool connect_wifi();
+  bool connect_server_if_due();
+
+  Derived &derived() { return *static_cast<Derived *>(this); }
+
+protected: // Attributes
+  const char *wifi_ssid;
+  const char *wifi_pass;
+  const char *server_address;
+  const uint16_t server_port;
+  const bool use_serial;
+  const uint32_t wifi_connected_check_delay_msecs;
+  const uint32_t wifi_connected_check_times;
+  const uint32_t server_retry_connect_delay_msecs;
+
+  bool has_attempted_server_connect = false;
+  uint32_t last_server_connect_attempt_msecs = 0;
+  uint32_t server_connect_count = 0;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+template <typename Derived>
+WifiTransport<Derived>::WifiTransport(
+    const char *wifi_ssid, const char *wifi_pass,
+    const char *server_address, const uint16_t server_port,
+    const bool use_serial,
+    const uint32_t wifi_connected_check_delay_msecs, const uint32_t wifi_connected_check_times,
+    const uint32_t server_retry_connect_delay_msecs)
+    : wifi_ssid(wifi_ssid), wifi_pass(wifi_pass),
+      server_address(server_address), server_port(server_port),
+      use_serial(use_serial),
+      wifi_connected_check_delay_msecs(wifi_connected_check_delay_msecs), wifi_connected_check_times(wifi_connected_check_times),
+      server_retry_connect_delay_msecs(server_retry_connect_delay_msecs)
+{
+}
+
+template <typename Derived>
+void WifiTransport<Derived>::first_connect()
+{
+  if (connect_wifi())
+    connect_server_if_due();
+}
+
+template <typename Derived>
+void WifiTransport<Derived>::reconnect_if_needed()
+{
+  // Check if wifi is still connected
+  if (WiFi.status() != WL_CONNECTED)
+  {
+    // Wifi was disconnected, try to reconnect
+    if (use_serial)
+      Serial.println(F("Wifi was disconnected, reconnecting..."));
+    if (!connect_wifi())
+      return;
+  }
+
+  derived().poll_server();
+
+  // Check if the server connection is still usable
+  if (!derived().is_server_connected())
+  {
+    derived().disconnect_server();
+    connect_server_if_due();
+  }
+}
+
+template <typename Derived>
+bool WifiTransport<Derived>::send_data_point(const char *message, size_t length, ContentEncoding encoding)
+{
+  if (!derived().is_server_connected() && !connect_server_if_due())
+  {
+    if (use_serial)
+      Serial.println(F("Not connected to the server, dropping message"));
+    return false;
+  }
+
+  return derived().send_data_point_impl(message, length, encoding);
+}
+
+///                                      ///
+// Protected class method implementations //
+///                                      ///
+
+template <typename Derived>
+bool WifiTransport<Derived>::connect_wifi()
+{
+  // Another transport may share the same wifi connection
+  if (WiFi.status() == WL_CONNECTED)
+    return true;
+
+  if (use_serial)
+  {
+    Serial.print(F("Connecting to wifi with SSID: "));
+    Serial.println(wifi_ssid);
+  }
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(wifi_ssid, wifi_pass);
+  uint32_t i = 0;
+  while (WiFi.status() != WL_CONNECTED)
+  {
+    if (i >= wifi_connected_check_times)
+    {
+      if (use_serial)
+        Serial.println(F("Failed to connect to wifi"));
+      return false;
+    }
+    i++;
+    if (use_serial)
+      Serial.print(".");
+    delay(wifi_connected_check_delay_msecs);
+  }
+  if (use_serial)
+  {
+    Serial.println();
+    Serial.println(F("Successfully connected to wifi"));
+  }
+  return true;
+}
+
+template <typename Derived>
+bool WifiTransport<Derived>::connect_server_if_due()
+{
+  // Don't block the caller on every call while the server is unreachable
+  const uint32_t curr_timestamp_msecs = millis();
+  if (has_attempted_server_connect && curr_timestamp_msecs - last_server_connect_attempt_msecs < server_retry_connect_delay_msecs)
+    return false;
+  has_attempted_server_connect = true;
+  last_server_connect_attempt_msecs = curr_timestamp_msecs;
+
+  if (derived().connect_server())
+  {
+    server_connect_count++;
+    return true;
+  }
+
+  if (use_serial)
+  {
+    Serial.print(F("Failed to connect to the server, retrying in "));
+    Serial.print(server_retry_connect_delay_msecs);
+    Serial.println(F("ms"));
+  }
+  return false;
+}
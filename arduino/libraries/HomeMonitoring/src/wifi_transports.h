@@ -0,0 +1,9 @@
+#pragma once
+
+// Includes every transport, so a sketch can pick one at compile time (see the UploadTransport alias in settings.h)
+// All of them share the same constructor arguments and the send_data_point(...) method
+
+#include "wifi_http_client.h"
+#include "wifi_https_client.h"
+#include "wifi_mqtt_client.h"
+#include "wifi_udp_client.h"
@@ -0,0 +1,120 @@
+#pragma once
+
+///        ///
+// Includes //
+///        ///
+
+#include <WiFiUdp.h>
+#include "wifi_transport.h"
+
+///                 ///
+// Class declaration //
+///                 ///
+
+/*
+ * Fire-and-forget transport: every message is sent as a single udp datagram, without acknowledgement.
+ * Lowest latency and airtime of all transports, intended for high-rate data where losing the odd point is fine.
+ * Messages must fit in one datagram (keep them below max_message_size to avoid ip fragmentation).
+ */
+class WifiUdpClient : public WifiTransport<WifiUdpClient>
+{
+public: // Constants
+  static constexpr uint16_t default_port = 8081;
+  static constexpr size_t max_message_size = 1400; // Stays below the usual 1500 byte MTU
+
+public: // Public methods
+  /*
+   * If use_serial is true, it is assumed that Serial.begin(...) is called in setup().
+   * The constructor does nothing but store its arguments.
+   */
+  WifiUdpClient(
+      const char *wifi_ssid, const char *wifi_pass,
+      const char *udp_server_address, const uint16_t udp_server_port = default_port,
+      const bool use_serial = false,
+      const uint32_t wifi_connected_check_delay_msecs = 1000, const uint32_t wifi_connected_check_times = 5,
+      const uint32_t udp_retry_connect_delay_msecs = 8000);
+
+  bool send_datagram(const uint8_t *data, size_t size);
+
+private: // WifiTransport implementation
+  friend class WifiTransport<WifiUdpClient>;
+
+  bool connect_server();
+  bool is_server_connected();
+  void disconnect_server();
+  void poll_server();
+  bool send_data_point_impl(const char *message, size_t length, ContentEncoding encoding);
+
+private: // Attributes
+  WiFiUDP udp;
+  bool is_udp_started = false;
+};
+
+///                                   ///
+// Public class method implementations //
+///                                   ///
+
+WifiUdpClient::WifiUdpClient(
+    const char *wifi_ssid, const char *wifi_pass,
+    const char *udp_server_address, const uint16_t udp_server_port,
+    const bool use_serial,
+    const uint32_t wifi_connected_check_delay_msecs, const uint32_t wifi_connected_check_times,
+    const uint32_t udp_retry_connect_delay_msecs)
+    : WifiTransport(
+          wifi_ssid, wifi_pass,
+          udp_server_address, udp_server_port,
+          use_serial,
+          wifi_connected_check_delay_msecs, wifi_connected_check_times,
+          udp_retry_connect_delay_msecs)
+{
+}
+
+bool WifiUdpClient::send_datagram(const uint8_t *data, size_t size)
+{
+  if (!udp.beginPacket(server_address, server_port))
+    return false;
+  udp.write(data, size);
+  return udp.endPacket() == 1;
+}
+
+///                                    ///
+// Private class method implementations //
+///                                    ///
+
+bool WifiUdpClient::connect_server()
+{
+  // There is no connection, only bind a local (random) port to send from
+  is_udp_started = udp.begin(0) == 1;
+  return is_udp_started;
+}
+
+bool WifiUdpClient::is_server_connected()
+{
+  return is_udp_started;
+}
+
+void WifiUdpClient::disconnect_server()
+{
+  udp.stop();
+  is_udp_started = false;
+}
+
+void WifiUdpClient::poll_server()
+{
+  // Nothing is ever received
+}
+
+// Datagrams carry no encoding, the collector recognizes gzip and binary messages by their magic bytes (json never starts with them)
+bool WifiUdpClient::send_data_point_impl(const char *message, size_t length, ContentEncoding /* encoding */)
+{
+  if (!send_datagram((const uint8_t *)message, length))
+  {
+    if (use_serial)
+      Serial.println(F("Failed to send udp datagram"));
+    return false;
+  }
+
+  if (use_serial)
+    Serial.println(F("Successfully sent udp datagram"));
+  return true;
+}
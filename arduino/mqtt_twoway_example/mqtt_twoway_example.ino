@@ -5,6 +5,7 @@
 //   - Install esp8266 boards through the board manager (contains a good WiFiClient.h for arduinos)
 //   - Install ArduinoMqttClient through the library manager
 //   - Install ArduinoJson through the library manager
+//   - Set the sketchbook location (File -> Preferences) to the "arduino" folder of this repository (for the HomeMonitoring library)
 
 ///        ///
 // Includes //
@@ -12,8 +13,9 @@
 
 #include <ArduinoJson.h>
 
-#include "wifi_mqtt_client.h"
-#include "util.h"
+#include <wifi_mqtt_client.h>
+#include <mqtt_commands.h>
+#include <runtime_config.h>
 
 #include "settings.h" // Create by copying settings.h.example to settings.h and filling in the dummy values
 
@@ -29,7 +31,64 @@ WifiMqttClient client(
     settings.incoming_message_size_limit
 );
 
-const String topic("data-points");
+const String data_points_topic("data-points");
+// Commands are received on "commands/<device_identifier>/<command name>", with their arguments as json payload
+const String command_topic_prefix = String("commands/") + settings.device_identifier + String("/");
+// Replies are sent to "command-responses/<device_identifier>"
+const String command_response_topic = String("command-responses/") + settings.device_identifier;
+
+// Settings that can be changed at runtime, with a json object on the retained "config/<device_identifier>" topic
+// The defaults come from settings.h, the active values are echoed on "config-active/<device_identifier>"
+struct TunableSettings
+{
+  uint32_t publish_interval_msecs = settings.publish_interval_msecs;
+  uint32_t incoming_message_size_limit = settings.incoming_message_size_limit;
+};
+const RuntimeSettingDescriptor<TunableSettings> tunable_setting_descriptors[] = {
+    // name, member, min, max
+    {"publish_interval_msecs", &TunableSettings::publish_interval_msecs, 1000, 3600000},
+    {"incoming_message_size_limit", &TunableSettings::incoming_message_size_limit, 128, 8192},
+};
+RuntimeConfig runtime_config(tunable_setting_descriptors, "runtime_config");
+const String config_topic = String("config/") + settings.device_identifier;
+const String active_config_topic = String("config-active/") + settings.device_identifier;
+
+
+///        ///
+// Commands //
+///        ///
+
+struct TurnOnCommand
+{
+  static constexpr const char *name = "on";
+  using Args = NoCommandArgs;
+  static void handle(const Args &args, CommandReply &reply);
+};
+
+struct TurnOffCommand
+{
+  static constexpr const char *name = "off";
+  using Args = NoCommandArgs;
+  static void handle(const Args &args, CommandReply &reply);
+};
+
+// Example payload: {"times": 3, "interval_msecs": 200}
+struct BlinkCommand
+{
+  static constexpr const char *name = "blink";
+  struct Args
+  {
+    uint8_t times;
+    uint16_t interval_msecs;
+
+    static constexpr size_t json_capacity = JSON_OBJECT_SIZE(2);
+    static bool decode(JsonObjectConst json, Args &args);
+  };
+  static void handle(const Args &args, CommandReply &reply);
+};
+
+// Add new commands here
+using Commands = CommandDispatcher<TurnOnCommand, TurnOffCommand, BlinkCommand>;
 
 
 ///                     ///
@@ -40,8 +99,8 @@ void setup();
 void loop();
 void read_and_publish_data();
 void on_mqtt_message(String &topic, String &message);
-void turn_on();
-void turn_off();
+void publish_command_reply(const char *command_name, const CommandReply &reply);
+void on_config_message(String &message);
 
 
 ///                    ///
@@ -51,9 +110,12 @@ void turn_off();
 void setup()
 {
   if (settings.use_serial) Serial.begin(115200);
+  runtime_config.init();
+  client.set_incoming_message_size_limit(runtime_config.get().incoming_message_size_limit);
   client.first_connect();
-  client.subscribe(topic);
-  client.set_on_message(on_mqtt_message);
+  client.set_on_message(on_mqtt_message); // Before subscribing, the retained config arrives right away
+  client.subscribe(command_topic_prefix + "+");
+  client.subscribe(config_topic);
 }
 
 void loop()
@@ -66,7 +128,7 @@ void loop()
   // Call read_and_publish_data() every publish_interval_msecs
   {
     static uint32_t state = 0;
-    run_in_interval_nonblocking(&state, settings.publish_interval_msecs, read_and_publish_data);
+    run_in_interval_nonblocking(&state, runtime_config.get().publish_interval_msecs, read_and_publish_data);
   }
 }
 
@@ -89,45 +151,95 @@ void read_and_publish_data()
     serializeJson(json, json_string);
   }
   
-  client.publish(topic, json_string);
+  client.publish(data_points_topic, json_string);
 }
 
 void on_mqtt_message(String &topic, String &message)
 {
-  DynamicJsonParseResult parse_result = dynamic_json_parse(message, settings.incoming_message_size_limit, settings.use_serial); // Gets destroyed when leaving this scope
-  if (!parse_result.success) return;
-  DynamicJsonDocument &json = parse_result.json;
-  
-  if (json["target"] == "me")
+  if (topic == config_topic)
+  {
+    on_config_message(message);
+    return;
+  }
+  if (!topic.startsWith(command_topic_prefix)) return;
+  const char *command_name = topic.c_str() + command_topic_prefix.length();
+
+  CommandReply reply;
+  Commands::dispatch(command_name, strlen(command_name), message.c_str(), message.length(), reply);
+
+  if (settings.use_serial && !reply.success)
   {
-    if (json["command"] == "on")
-    {
-      turn_on();
-    }
-    else if (json["command"] == "off")
-    {
-      turn_off();
-    }
-    else
-    {
-      if (settings.use_serial)
-      {
-        Serial.print("Unknown command: \"");
-        Serial.print((const char*)json["command"]);
-        Serial.println("\"");
-      }
-    }
+    Serial.print("Command \"");
+    Serial.print(command_name);
+    Serial.print("\" failed: ");
+    Serial.println(reply.message);
   }
+
+  publish_command_reply(command_name, reply);
 }
 
-void turn_on()
+void publish_command_reply(const char *command_name, const CommandReply &reply)
+{
+  String json_string;
+  {
+    // Use https://arduinojson.org/v6/assistant to get the recommended static document size
+    StaticJsonDocument<64> json; // Gets destroyed when leaving this scope
+
+    // Stored as pointers, not copied
+    json["command"] = command_name;
+    json["success"] = reply.success;
+    json["message"] = (const char *)reply.message;
+
+    serializeJson(json, json_string);
+  }
+
+  client.publish(command_response_topic, json_string);
+}
+
+void on_config_message(String &message)
+{
+  const char *error = nullptr;
+  if (runtime_config.apply_json(message.c_str(), message.length(), &error))
+    client.set_incoming_message_size_limit(runtime_config.get().incoming_message_size_limit);
+
+  String json_string;
+  runtime_config.serialize_active(json_string, error);
+  client.publish(active_config_topic, json_string, true);
+}
+
+
+///                           ///
+// Command handler definitions //
+///                           ///
+
+void TurnOnCommand::handle(const Args &/* args */, CommandReply &/* reply */)
 {
   if (settings.use_serial) Serial.println("Setting state to on");
   // Some digitalWrite code
 }
 
-void turn_off()
+void TurnOffCommand::handle(const Args &/* args */, CommandReply &/* reply */)
 {
   if (settings.use_serial) Serial.println("Setting state to off");
   // Some digitalWrite code
 }
+
+bool BlinkCommand::Args::decode(JsonObjectConst json, Args &args)
+{
+  if (!json["times"].is<uint8_t>() || !json["interval_msecs"].is<uint16_t>()) return false;
+  args.times = json["times"];
+  args.interval_msecs = json["interval_msecs"];
+  return args.times > 0 && args.interval_msecs > 0;
+}
+
+void BlinkCommand::handle(const Args &args, CommandReply &reply)
+{
+  if (settings.use_serial)
+  {
+    Serial.print("Blinking ");
+    Serial.print(args.times);
+    Serial.println(" times");
+  }
+  // Some digitalWrite code, every args.interval_msecs
+  snprintf(reply.message, sizeof(reply.message), "Blinked %u times", (unsigned)args.times);
+}
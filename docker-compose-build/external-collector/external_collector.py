@@ -1,22 +1,527 @@
-import os, time, json, logging
+import os, time, json, logging, socket, ssl, struct, zlib
 
-from queue import Queue
-from threading import Thread
+from collections import deque
+from queue import Queue, Empty, Full
+from threading import Thread, Lock
 
 from influxdb_client import InfluxDBClient, Point, WritePrecision
-from influxdb_client.client.write_api import SYNCHRONOUS
-from influxdb_client.rest import ApiException
+from influxdb_client.client.write_api import WriteOptions
 
 import paho.mqtt.client as mqtt
 
 from flask import Flask, request, Response
+from werkzeug.serving import WSGIRequestHandler
 from http import HTTPStatus
 
+######################
+# data point writing #
+######################
+
+# Data points are handed to the batching write api of influxdb_client, which writes them per bucket in batches
+# of up to WRITE_BATCH_SIZE, at least every WRITE_FLUSH_INTERVAL_MSECS, in the background
+WRITE_BATCH_SIZE = int(os.environ.get("WRITE_BATCH_SIZE", 1000))
+WRITE_FLUSH_INTERVAL_MSECS = int(os.environ.get("WRITE_FLUSH_INTERVAL_MSECS", 1000))
+# A failed batch is retried up to WRITE_MAX_RETRIES times, WRITE_RETRY_INTERVAL_MSECS after the first failure and twice as long every next time
+WRITE_MAX_RETRIES = int(os.environ.get("WRITE_MAX_RETRIES", 5))
+WRITE_RETRY_INTERVAL_MSECS = int(os.environ.get("WRITE_RETRY_INTERVAL_MSECS", 5000))
+# Data points handed over but not written yet, messages stay queued above this (e.g. while influxdb is down)
+MAX_PENDING_POINT_COUNT = int(os.environ.get("MAX_PENDING_POINT_COUNT", 50000))
+
+# Validates a data point json object and converts it to influxdb line protocol
+# unix_time is used when the data point has no "time" of its own
+# Returns (bucket, line), or None (after logging why) if the data point is invalid
+def make_data_point(msg, unix_time: int):
+    # Validate the data point json structure
+    # Example:
+    # {
+    #     "measurement": "water_depth",
+    #     "tags": {"location": "some_canal"}, // Optional
+    #     "fields": {"depth_in_meters": 1},
+    #     "time": "1500000001000000000", // Optional, generated automatically (nanosecs since unix epoch),
+    #     "bucket": "rivers" // Optional, defaults to "default"
+    # }
+    try:
+        assert type(msg) == dict, "The data point is not a json object"
+
+        assert "measurement" in msg, "The field \"measurement\" is missing"
+        assert type(msg["measurement"]) == str, "The field \"measurement\" is not a string"
+
+        if "tags" in msg:
+            assert type(msg["tags"]) == dict, "The provided optional field \"tags\" is not an object"
+            for key, value in msg["tags"].items():
+                assert type(key) == str and type(value) == str, f"The provided object \"tags\" has an entry with invalid type(s): \"{key}:{value}\", should both be strings"
+
+        assert "fields" in msg, "The field \"fields\" is missing"
+        assert type(msg["fields"]) == dict, "The field \"fields\" is not an object"
+        for key, value in msg["fields"].items():
+            assert type(key) == str, f"The object \"fields\" has a non-string key: \"{key}\""
+
+        if "time" in msg:
+            assert type(msg["time"]) == str, "The provided optional field \"time\" is not a nanosecond unix timestamp string"
+
+        if "bucket" in msg:
+            assert type(msg["bucket"]) == str, "The provided optional field \"buckket\" is not a string"
+    except AssertionError as e:
+        logging.warning(f"Validation failed for data point \"{json.dumps(msg)}\": {str(e)}")
+        return None
+
+    # Set the data point time
+    if "time" in msg:
+        # Reassign unix_time
+        try:
+            unix_time = int(msg["time"])
+        except ValueError:
+            logging.warning(f"Validation failed for data point \"{json.dumps(msg)}\": The provided optional field \"time\" is not a nanosecond unix timestamp string")
+            return None
+    msg["time"] = unix_time
+
+    # Create the data point
+    try:
+        line = Point.from_dict(msg, WritePrecision.NS).to_line_protocol()
+    except (TypeError, ValueError, KeyError) as e:
+        # Field values influxdb can't store (objects, arrays, ...)
+        logging.warning(f"Dropping data point that can't be written to influxdb: \"{json.dumps(msg)}\": {str(e)}")
+        return None
+    if not line:
+        logging.warning(f"Dropping data point without field values: \"{json.dumps(msg)}\"")
+        return None
+
+    bucket = msg["bucket"] if "bucket" in msg else "default"
+    return bucket, line
+
+# Writes data points through the batching write api, and tells which ones were written once influxdb confirmed them
+# The write api calls back with the line protocol of every batch it wrote, retried or gave up on (from its own threads),
+# lines are matched with the pending data points here (only used from the message_queue_processor thread)
+class BatchWriter:
+    def __init__(self, client: InfluxDBClient, org: str):
+        self.org = org
+        self.completions = Queue() # (outcome, data, time) from the callbacks
+        self.pending_contexts = {} # Per line, in the order they were written
+        self.pending_count = 0
+        self.batch_count = 0 # Since the last report
+        self.written_count = 0
+        self.failed_count = 0
+        self.retry_count = 0
+        self.write_api = client.write_api(
+            write_options=WriteOptions(
+                batch_size=WRITE_BATCH_SIZE,
+                flush_interval=WRITE_FLUSH_INTERVAL_MSECS,
+                jitter_interval=0,
+                retry_interval=WRITE_RETRY_INTERVAL_MSECS,
+                max_retries=WRITE_MAX_RETRIES,
+                exponential_base=2
+            ),
+            success_callback=lambda conf, data: self.completions.put(("written", data, time.time_ns())),
+            error_callback=self.on_error,
+            retry_callback=lambda conf, data, exception: self.completions.put(("retried", data, time.time_ns()))
+        )
+
+    def on_error(self, conf, data, exception):
+        bucket = conf[0]
+        # ApiException has the status itself, InfluxDBError (raised by the batching write api) in its http response
+        status = getattr(exception, "status", None) or getattr(getattr(exception, "response", None), "status", None)
+        if status == 404:
+            logging.warning(f"Failed writing data points: bucket \"{bucket}\" does not exist")
+        else:
+            logging.warning(f"Failed writing data points to bucket \"{bucket}\", giving up: {str(exception)}")
+        self.completions.put(("failed", data, time.time_ns()))
+
+    # context is returned by take_written once the data point is written
+    def write(self, bucket: str, line: str, context=None):
+        self.pending_contexts.setdefault(line, deque()).append(context)
+        self.pending_count += 1
+        self.write_api.write(bucket=bucket, org=self.org, record=line, write_precision=WritePrecision.NS)
+
+    # Returns (context, write time) of the data points written since the last call
+    # Waits up to timeout secs for the next batch if none completed yet
+    def take_written(self, timeout: float = 0):
+        written = []
+        try:
+            completion = self.completions.get(timeout=timeout) if timeout > 0 else self.completions.get_nowait()
+            while True:
+                outcome, data, completion_time = completion
+                if outcome == "retried":
+                    self.retry_count += 1
+                else:
+                    self.batch_count += 1
+                    for line in (data.decode() if type(data) == bytes else data).split("\n"):
+                        contexts = self.pending_contexts.get(line)
+                        if contexts is None:
+                            continue
+                        context = contexts.popleft()
+                        if len(contexts) == 0:
+                            del self.pending_contexts[line]
+                        self.pending_count -= 1
+                        if outcome == "written":
+                            self.written_count += 1
+                            written.append((context, completion_time))
+                        else:
+                            self.failed_count += 1
+                completion = self.completions.get_nowait()
+        except Empty:
+            pass
+        return written
+
+    # Returns the report as influxdb fields, the counts start over
+    def take_report(self):
+        fields = {
+            "write_batches": self.batch_count,
+            "written_points": self.written_count,
+            "failed_points": self.failed_count,
+            "write_retries": self.retry_count,
+            "pending_points": self.pending_count
+        }
+        self.batch_count = self.written_count = self.failed_count = self.retry_count = 0
+        return fields
+
+    # Writes what is still batched
+    def close(self):
+        self.write_api.close()
+
+####################
+# message decoding #
+####################
+
+GZIP_MAGIC = b"\x1f\x8b"
+# Limits what a small compressed message can expand to
+MAX_DECOMPRESSED_MESSAGE_SIZE = 1024 * 1024
+
+# Returns the message as json text, or None (after logging why) if it can't be decompressed
+# encoding is "identity" or "gzip"
+def decode_message(payload: bytes, encoding: str):
+    if encoding == "identity":
+        return payload
+    try:
+        decompressor = zlib.decompressobj(wbits=16 + zlib.MAX_WBITS) # + 16 = gzip header and trailer
+        decompressed = decompressor.decompress(payload, MAX_DECOMPRESSED_MESSAGE_SIZE)
+        assert decompressor.eof, f"The message is truncated or decompresses to more than {MAX_DECOMPRESSED_MESSAGE_SIZE} bytes"
+        return decompressed
+    except (zlib.error, AssertionError) as e:
+        logging.warning(f"Invalid gzip message of {len(payload)} bytes: {str(e)}")
+        return None
+
+###################
+# binary messages #
+###################
+
+# Binary messages hold records: json records (data points or descriptor registrations, as in json messages)
+# and point records (a data point with its fields as raw integers, named by a schema). See binary_point.h for the layout.
+BINARY_MESSAGE_MAGIC = b"HMB"
+BINARY_MESSAGE_VERSION = 1
+BINARY_JSON_RECORD = 1
+BINARY_POINT_RECORD = 2
+BINARY_POINT_HAS_TIME = 1 << 0
+BINARY_POINT_HAS_DESCRIPTOR = 1 << 1
+BINARY_POINT_HAS_TRACE = 1 << 2
+BINARY_POINT_HAS_TRACE_CAPTURE_TIME = 1 << 3
+
+# Schemas of point records by id, the same as binary_schemas.h (fields in field id order)
+# Field kinds: "milli" (a decimal sent in milli-units), "integer", "string" (an integer stored as a string, zero-padded to a width)
+# Values are unsigned 32-bit integers on the wire, like the FixedValue and integer fields of the DSMR parser
+# The fields end up in influxdb with the same names and types as their json equivalent
+BINARY_SCHEMAS = {
+    1: {
+        "bucket": "fluvius_smart_meter",
+        "measurement": "fluvius_smart_meter_electricity",
+        "fields": [
+            ("electricity_switch_position", "integer"),
+            ("electricity_threshold", "milli"),
+            ("current_max", "integer"),
+            ("electricity_tariff", "string", 4),
+            ("energy_delivered_tariff1", "milli"),
+            ("energy_delivered_tariff2", "milli"),
+            ("energy_returned_tariff1", "milli"),
+            ("energy_returned_tariff2", "milli"),
+            ("power_delivered", "milli"),
+            ("power_delivered_l1", "milli"),
+            ("power_delivered_l2", "milli"),
+            ("power_delivered_l3", "milli"),
+            ("power_returned", "milli"),
+            ("power_returned_l1", "milli"),
+            ("power_returned_l2", "milli"),
+            ("power_returned_l3", "milli"),
+            ("voltage_l1", "milli"),
+            ("voltage_l2", "milli"),
+            ("voltage_l3", "milli"),
+            ("current_l1", "milli"),
+            ("current_l2", "milli"),
+            ("current_l3", "milli"),
+        ],
+    },
+    2: {
+        "bucket": "fluvius_smart_meter",
+        "measurement": "fluvius_smart_meter_gas",
+        "fields": [
+            ("gas_device_type", "string", 0),
+            ("gas_valve_position", "integer"),
+            ("gas_m3", "milli"),
+        ],
+    },
+}
+
+# Returns the data points of a binary message as json objects, or None (after logging why) if it's malformed
+# Point records of an unknown schema, and fields unknown to their schema (both from newer devices), are skipped
+def decode_binary_message(payload: bytes):
+    try:
+        assert payload[:3] == BINARY_MESSAGE_MAGIC, "The message doesn't start with the binary message magic bytes"
+        assert len(payload) >= 4 and payload[3] == BINARY_MESSAGE_VERSION, f"The message is not of binary message version {BINARY_MESSAGE_VERSION}"
+
+        data_points = []
+        position = 4
+        while position < len(payload):
+            record_type = payload[position]
+            position += 1
+            if record_type == BINARY_JSON_RECORD:
+                (length,) = struct.unpack_from("<H", payload, position)
+                position += 2
+                assert position + length <= len(payload), "A json record is truncated"
+                data_points.append(json.loads(payload[position:position + length]))
+                position += length
+            elif record_type == BINARY_POINT_RECORD:
+                data_point, position = decode_binary_point_record(payload, position)
+                if data_point is not None:
+                    data_points.append(data_point)
+            else:
+                raise AssertionError(f"Unknown record type {record_type}")
+        return data_points
+    except (AssertionError, IndexError, struct.error, ValueError) as e:
+        logging.warning(f"Invalid binary message of {len(payload)} bytes: {str(e)}")
+        return None
+
+# Returns the data point (None if its schema is unknown) and the position after the record
+def decode_binary_point_record(payload: bytes, position: int):
+    schema_id, flags, field_bitmap = struct.unpack_from("<BBI", payload, position)
+    position += 6
+    schema = BINARY_SCHEMAS.get(schema_id)
+    data_point = {"bucket": schema["bucket"], "measurement": schema["measurement"]} if schema is not None else {}
+
+    if flags & BINARY_POINT_HAS_TIME:
+        data_point["time"] = str(struct.unpack_from("<Q", payload, position)[0])
+        position += 8
+    if flags & BINARY_POINT_HAS_DESCRIPTOR:
+        data_point["descriptor"] = struct.unpack_from("<I", payload, position)[0]
+        position += 4
+    if flags & BINARY_POINT_HAS_TRACE:
+        assert position < len(payload), "A trace source length is missing"
+        source_length = payload[position]
+        position += 1
+        assert position + source_length <= len(payload), "A trace source is truncated"
+        source = payload[position:position + source_length].decode(errors="replace")
+        position += source_length
+        data_point["trace"] = {"source": source, "sequence": struct.unpack_from("<I", payload, position)[0]}
+        position += 4
+        if flags & BINARY_POINT_HAS_TRACE_CAPTURE_TIME:
+            data_point["trace"]["capture_time"] = str(struct.unpack_from("<Q", payload, position)[0])
+            position += 8
+
+    fields = {}
+    for field_id in range(32):
+        if not field_bitmap & (1 << field_id):
+            continue
+        (value,) = struct.unpack_from("<I", payload, position)
+        position += 4
+        if schema is None or field_id >= len(schema["fields"]):
+            continue
+        name, kind, *options = schema["fields"][field_id]
+        if kind == "milli":
+            value = value / 1000 # The same float as parsing the json path's 3-decimal number
+        elif kind == "string":
+            value = str(value).zfill(options[0])
+        fields[name] = value
+    data_point["fields"] = fields
+
+    if schema is None:
+        logging.warning(f"Dropping binary data point of unknown schema {schema_id}")
+        return None, position
+    return data_point, position
+
+###############
+# descriptors #
+###############
+
+# Most recently registered descriptors, the oldest are forgotten first
+# Devices register theirs again on every reconnect and every minute or so, so a forgotten one comes back soon
+MAX_DESCRIPTOR_COUNT = 1024
+
+# Stores a descriptor registration: tags and fields that data points refer to by id, instead of carrying them
+# Example:
+# {
+#     "register_descriptor": 2166136261,
+#     "tags": {"meter_id": "1234"}, // Optional
+#     "fields": {"message_long": ""} // Optional
+# }
+def register_descriptor(descriptors: dict, msg):
+    try:
+        assert type(msg["register_descriptor"]) == int, "The field \"register_descriptor\" is not an integer"
+        for key in ["tags", "fields"]:
+            if key in msg:
+                assert type(msg[key]) == dict, f"The provided optional field \"{key}\" is not an object"
+    except AssertionError as e:
+        logging.warning(f"Validation failed for descriptor \"{json.dumps(msg)}\": {str(e)}")
+        return
+
+    descriptor_id = msg["register_descriptor"]
+    descriptors.pop(descriptor_id, None) # Re-inserting moves it to the end
+    descriptors[descriptor_id] = {"tags": msg.get("tags", {}), "fields": msg.get("fields", {})}
+    while len(descriptors) > MAX_DESCRIPTOR_COUNT:
+        del descriptors[next(iter(descriptors))]
+
+# Replaces the "descriptor" id of a data point by the descriptor's tags and fields, the data point's own take precedence
+# Returns None (after logging why) if the descriptor is not an integer or is unknown (e.g. the collector restarted since it was registered)
+def expand_descriptor(descriptors: dict, msg):
+    if type(msg["descriptor"]) != int:
+        logging.warning(f"Dropping data point whose field \"descriptor\" is not an integer: \"{json.dumps(msg)}\"")
+        return None
+    descriptor = descriptors.get(msg["descriptor"])
+    if descriptor is None:
+        logging.warning(f"Dropping data point with an unknown descriptor: \"{json.dumps(msg)}\"")
+        return None
+    del msg["descriptor"]
+    for key in ["tags", "fields"]:
+        if key in msg and type(msg[key]) != dict:
+            return msg # Left for write_data_point to report
+        msg[key] = {**descriptor[key], **msg.get(key, {})}
+    return msg
+
+###########
+# tracing #
+###########
+
+# Latencies of the most recent data points are kept per stage, p50 and p99 are reported over them
+MAX_LATENCY_SAMPLE_COUNT = 10000
+# Sources whose last sequence number is kept, the oldest are forgotten first
+MAX_TRACE_SOURCE_COUNT = 1024
+LATENCY_REPORT_INTERVAL_SECS = int(os.environ.get("LATENCY_REPORT_INTERVAL_SECS", 60))
+
+# Measures how stale data points are by the time they're written to influxdb, and which ones never arrived
+# Every data point is timed from its receipt (queue wait, then processing and writing)
+# Data points can also carry a trace, to time them from the moment the device captured the reading:
+# {
+#     "trace": {
+#         "source": "esp-32 garage", // Sequence numbers are counted per source and measurement
+#         "sequence": 1234, // Incremented for every capture, gaps are data points that never arrived
+#         "capture_time": "1500000001000000000" // Optional (device clock, nanosecs since unix epoch)
+#     },
+#     ...
+# }
+# The trace is removed before writing, device latencies include the difference between the device clock and the collector's
+class LatencyTracker:
+    # device: capture to receipt, queue: receipt to dequeue, write: dequeue to written, total: capture to written
+    STAGES = ["device", "queue", "write", "total"]
+
+    def __init__(self):
+        self.latencies_nsecs = {stage: deque(maxlen=MAX_LATENCY_SAMPLE_COUNT) for stage in self.STAGES}
+        self.last_sequences = {}
+        self.gap_count = 0 # Since the last report
+        self.missing_count = 0
+        self.duplicate_count = 0
+        self.restart_count = 0
+
+    # Removes the trace from a data point and returns it, or None (after logging why) if it has none or it's invalid
+    def take_trace(self, msg):
+        trace = msg.pop("trace", None)
+        if trace is None:
+            return None
+        try:
+            assert type(trace) == dict, "The field \"trace\" is not an object"
+            assert type(trace.get("source")) == str, "The field \"trace.source\" is not a string"
+            assert type(trace.get("sequence")) == int, "The field \"trace.sequence\" is not an integer"
+            if "capture_time" in trace:
+                assert type(trace["capture_time"]) == str and trace["capture_time"].isdigit(), "The provided optional field \"trace.capture_time\" is not a nanosecond unix timestamp string"
+        except AssertionError as e:
+            logging.warning(f"Ignoring invalid trace \"{json.dumps(trace)}\": {str(e)}")
+            return None
+        return trace
+
+    # Records a written data point, trace is None for data points without one
+    def record(self, trace, receive_time: int, dequeue_time: int, write_time: int):
+        self.latencies_nsecs["queue"].append(dequeue_time - receive_time)
+        self.latencies_nsecs["write"].append(write_time - dequeue_time)
+        if trace is not None and "capture_time" in trace:
+            capture_time = int(trace["capture_time"])
+            self.latencies_nsecs["device"].append(receive_time - capture_time)
+            self.latencies_nsecs["total"].append(write_time - capture_time)
+
+    # Counts the gaps in the sequence numbers of a source, in the order data points are processed
+    # (batches can complete out of order, e.g. when one is retried)
+    def record_sequence(self, trace, measurement: str):
+        key = (trace["source"], measurement)
+        sequence = trace["sequence"]
+        last_sequence = self.last_sequences.pop(key, None) # Re-inserting moves it to the end
+        if last_sequence is not None:
+            if sequence > last_sequence + 1:
+                self.gap_count += 1
+                self.missing_count += sequence - last_sequence - 1
+            elif sequence == last_sequence:
+                self.duplicate_count += 1
+            elif sequence < last_sequence:
+                self.restart_count += 1 # The device rebooted (or data points were reordered)
+        self.last_sequences[key] = sequence
+        while len(self.last_sequences) > MAX_TRACE_SOURCE_COUNT:
+            del self.last_sequences[next(iter(self.last_sequences))]
+
+    # Returns the report as influxdb fields, the gap counts start over
+    def take_report(self):
+        fields = {}
+        for stage, latencies_nsecs in self.latencies_nsecs.items():
+            fields[f"{stage}_count"] = len(latencies_nsecs)
+            if len(latencies_nsecs) == 0:
+                continue
+            sorted_latencies_nsecs = sorted(latencies_nsecs)
+            for percentile in [50, 99]:
+                # Nearest rank
+                index = min(len(sorted_latencies_nsecs) - 1, (len(sorted_latencies_nsecs) * percentile + 99) // 100 - 1)
+                fields[f"{stage}_p{percentile}_msecs"] = sorted_latencies_nsecs[max(index, 0)] / 1_000_000
+        fields["gaps"] = self.gap_count
+        fields["missing_points"] = self.missing_count
+        fields["duplicate_points"] = self.duplicate_count
+        fields["source_restarts"] = self.restart_count
+        self.gap_count = self.missing_count = self.duplicate_count = self.restart_count = 0
+        return fields
+
+################
+# backpressure #
+################
+
+# Messages wait in a bounded queue, so a collector (or influxdb) that falls behind doesn't run out of memory
+MAX_QUEUED_MESSAGE_COUNT = int(os.environ.get("MAX_QUEUED_MESSAGE_COUNT", 10000))
+# Above this queue depth, http responses ask devices to wait BACKPRESSURE_RETRY_AFTER_SECS between messages (Retry-After header)
+BACKPRESSURE_QUEUE_DEPTH = int(os.environ.get("BACKPRESSURE_QUEUE_DEPTH", 1000))
+BACKPRESSURE_RETRY_AFTER_SECS = int(os.environ.get("BACKPRESSURE_RETRY_AFTER_SECS", 30))
+
+# The queue of (payload, unix_time, encoding) messages shared by the listener threads and the message_queue_processor thread
+# Messages that don't fit anymore are rejected: http answers 429, mqtt and udp messages are counted and dropped
+class MessageQueue(Queue):
+    def __init__(self):
+        super().__init__(maxsize=MAX_QUEUED_MESSAGE_COUNT)
+        self.rejected_count = 0 # Since the last report
+        self.rejected_count_lock = Lock()
+
+    # Returns False (after counting it) if the queue is full
+    def offer(self, message) -> bool:
+        try:
+            self.put_nowait(message)
+            return True
+        except Full:
+            with self.rejected_count_lock:
+                self.rejected_count += 1
+            return False
+
+    # Secs devices are asked to wait between messages, 0 while the queue keeps up
+    def get_retry_after_secs(self) -> int:
+        return BACKPRESSURE_RETRY_AFTER_SECS if self.qsize() >= BACKPRESSURE_QUEUE_DEPTH else 0
+
+    def take_rejected_count(self) -> int:
+        with self.rejected_count_lock:
+            rejected_count = self.rejected_count
+            self.rejected_count = 0
+        return rejected_count
+
 ##################################
 # message_queue_processor thread #
 ##################################
 
-def message_queue_processor_thread_entrypoint(message_queue: Queue):
+def message_queue_processor_thread_entrypoint(message_queue: MessageQueue):
     while True:
         try:
             try:
@@ -27,80 +532,12 @@ def message_queue_processor_thread_entrypoint(message_queue: Queue):
                 raise Exception(f"Missing environment variable: {str(e)}")
 
             client = InfluxDBClient(url=INFLUXDB_URL, token=INFLUXDB_TOKEN, org=INFLUXDB_ORG)
-
-            write_api = client.write_api(write_options=SYNCHRONOUS)
-
-            while True:
-                try:
-                    msg_str, unix_time = message_queue.get() # waits when empty
-                    logging.info(f"message_queue_processor_thread message: {msg_str}")
-
-                    # Parse message as json
-                    try:
-                        msg = json.loads(msg_str)
-                    except Exception:
-                        logging.warning(f"Invalid json message \"{msg_str}\":")
-                        continue
-
-                    # Validate the message json structure
-                    # Example:
-                    # {
-                    #     "measurement": "water_depth",
-                    #     "tags": {"location": "some_canal"}, // Optional
-                    #     "fields": {"depth_in_meters": 1},
-                    #     "time": 100000.123, // Optional, generated automatically (secs since unix epoch),
-                    #     "bucket": "rivers" // Optional, defaults to "default"
-                    # }
-                    try:
-                        assert type(msg) == dict, "The message is not a json object"
-
-                        assert "measurement" in msg, "The field \"measurement\" is missing"
-                        assert type(msg["measurement"]) == str, "The field \"measurement\" is not a string"
-
-                        if "tags" in msg:
-                            assert type(msg["tags"]) == dict, "The provided optional field \"tags\" is not an object"
-                            for key, value in msg["tags"].items():
-                                assert type(key) == str and type(value) == str, f"The provided object \"tags\" has an entry with invalid type(s): \"{key}:{value}\", should both be strings"
-
-                        assert "fields" in msg, "The field \"fields\" is missing"
-                        assert type(msg["fields"]) == dict, "The field \"fields\" is not an object"
-                        for key, value in msg["fields"].items():
-                            assert type(key) == str, f"The object \"fields\" has a non-string key: \"{key}\""
-
-                        if "time" in msg:
-                            assert type(msg["time"]) == str, "The provided optional field \"time\" is not a nanosecond unix timestamp string"
-
-                        if "bucket" in msg:
-                            assert type(msg["bucket"]) == str, "The provided optional field \"buckket\" is not a string"
-                    except AssertionError as e:
-                        logging.warning(f"Validation failed for message \"{msg_str}\": {str(e)}")
-                        continue
-
-                    # Set the data point time
-                    if "time" in msg:
-                        # Reassign unix_time
-                        unix_time = int(msg["time"])
-                    msg["time"] = unix_time
-
-                    # Create and the data point
-                    data_point = Point.from_dict(msg, WritePrecision.NS)
-
-                    # Write the data point to a bucket
-                    bucket = msg["bucket"] if "bucket" in msg else "default"
-                    try:
-                        write_api.write(
-                            bucket=bucket,
-                            org=INFLUXDB_ORG,
-                            record=data_point
-                        )
-                    except ApiException as e:
-                        if e.status == 404:
-                            logging.warning(f"Failed writing data point: bucket \"{bucket}\" does not exist")
-                            continue
-                        else:
-                            raise e
-                finally:
-                    message_queue.task_done()
+            batch_writer = BatchWriter(client, INFLUXDB_ORG)
+            try:
+                process_messages(message_queue, batch_writer)
+            finally:
+                batch_writer.close()
+                client.close()
         except Exception as e:
             logging.error(type(e))
             logging.error(f"Exception in message_queue_processor_thread: {str(e)}")
@@ -108,11 +545,85 @@ def message_queue_processor_thread_entrypoint(message_queue: Queue):
             logging.error(f"Restarting message_queue_processor_thread in {wait_secs} {'sec' if wait_secs == 1 else 'secs'}")
             time.sleep(wait_secs)
 
+# Hands the data points of every message to batch_writer, and records the latencies of the ones it wrote
+def process_messages(message_queue: MessageQueue, batch_writer: BatchWriter):
+    descriptors = {} # Only used from this thread
+    latency_tracker = LatencyTracker() # Only used from this thread
+    next_latency_report_time = time.monotonic() + LATENCY_REPORT_INTERVAL_SECS
+    max_queue_depth = 0 # Since the last report
+
+    while True:
+        max_queue_depth = max(max_queue_depth, message_queue.qsize())
+        if time.monotonic() >= next_latency_report_time:
+            next_latency_report_time += LATENCY_REPORT_INTERVAL_SECS
+            report = {
+                **latency_tracker.take_report(),
+                **batch_writer.take_report(),
+                "queue_depth": message_queue.qsize(),
+                "max_queue_depth": max_queue_depth,
+                "rejected_messages": message_queue.take_rejected_count()
+            }
+            max_queue_depth = 0
+            logging.info(f"Latency report: {json.dumps(report)}")
+            batch_writer.write(*make_data_point({"bucket": "heartbeat", "measurement": "collector_latency", "fields": report}, time.time_ns()))
+
+        # Influxdb doesn't keep up (or is down), leave the messages queued until batches complete
+        backlogged = batch_writer.pending_count >= MAX_PENDING_POINT_COUNT
+        for context, write_time in batch_writer.take_written(timeout=1 if backlogged else 0):
+            if context is not None:
+                latency_tracker.record(*context, write_time)
+        if backlogged:
+            continue
+
+        try:
+            payload, unix_time, encoding = message_queue.get(timeout=0.1) # waits when empty, but still collects written batches and reports on time
+        except Empty:
+            continue
+        try:
+            dequeue_time = time.time_ns()
+            if encoding == "binary":
+                msg = decode_binary_message(payload)
+                if msg is None:
+                    continue
+                logging.info(f"message_queue_processor_thread binary message: {json.dumps(msg)}")
+            else:
+                msg_str = decode_message(payload, encoding)
+                if msg_str is None:
+                    continue
+                logging.info(f"message_queue_processor_thread message: {msg_str}")
+
+                # Parse message as json
+                try:
+                    msg = json.loads(msg_str)
+                except Exception:
+                    logging.warning(f"Invalid json message \"{msg_str}\":")
+                    continue
+
+            # A message holds one data point, or a json array of them (sent in batches)
+            data_points = msg if type(msg) == list else [msg]
+            for data_point in data_points:
+                if type(data_point) == dict and "register_descriptor" in data_point:
+                    register_descriptor(descriptors, data_point)
+                    continue
+                if type(data_point) == dict and "descriptor" in data_point:
+                    expanded_data_point = expand_descriptor(descriptors, data_point)
+                    if expanded_data_point is None:
+                        continue
+                    data_point = expanded_data_point
+                trace = latency_tracker.take_trace(data_point) if type(data_point) == dict else None
+                bucket_and_line = make_data_point(data_point, unix_time)
+                if bucket_and_line is not None:
+                    batch_writer.write(*bucket_and_line, (trace, unix_time, dequeue_time))
+                    if trace is not None:
+                        latency_tracker.record_sequence(trace, data_point["measurement"])
+        finally:
+            message_queue.task_done()
+
 ##########################
 # mqtt_subscriber thread #
 ##########################
 
-def mqtt_subscriber_thread_entrypoint(message_queue: Queue):
+def mqtt_subscriber_thread_entrypoint(message_queue: MessageQueue):
     while True:
         try:
             try:
@@ -128,11 +639,15 @@ def mqtt_subscriber_thread_entrypoint(message_queue: Queue):
             def on_connect(client, userdata, flags, rc):
                 logging.info(f"Connected to \"mqtt://{MQTT_BROKER_ADDRESS}:{MQTT_BROKER_PORT}\" with result code \"{str(rc)}\"")
                 client.subscribe("data-points")
+                client.subscribe("data-points/gzip")
+                client.subscribe("data-points/binary")
 
             def on_message(client, userdata, msg):
-                if msg.topic == "data-points":
+                # Mqtt 3.1.1 has no content type property, gzipped and binary messages have their own topic
+                encodings = {"data-points": "identity", "data-points/gzip": "gzip", "data-points/binary": "binary"}
+                if msg.topic in encodings:
                     unix_time = int(time.time() * 1_000_000_000) # utc nanosecond unix timestamp
-                    message_queue.put((msg.payload, unix_time))
+                    message_queue.offer((msg.payload, unix_time, encodings[msg.topic])) # Counted as rejected if the queue is full
 
             client = mqtt.Client()
             client.on_connect = on_connect
@@ -147,23 +662,84 @@ def mqtt_subscriber_thread_entrypoint(message_queue: Queue):
             logging.error(f"Restarting mqtt_subscriber_thread in {wait_secs} {'sec' if wait_secs == 1 else 'secs'}")
             time.sleep(wait_secs)
 
+#######################
+# udp_listener thread #
+#######################
+
+def udp_listener_thread_entrypoint(message_queue: MessageQueue):
+    while True:
+        try:
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.bind(("0.0.0.0", 8081))
+            logging.info("Listening for udp datagrams on port 8081")
+
+            while True:
+                # Each datagram holds exactly one message
+                # Datagrams carry no encoding, but json never starts with the gzip or binary message magic bytes
+                datagram, address = sock.recvfrom(65535)
+                unix_time = int(time.time() * 1_000_000_000) # utc nanosecond unix timestamp
+                if datagram.startswith(GZIP_MAGIC):
+                    encoding = "gzip"
+                elif datagram.startswith(BINARY_MESSAGE_MAGIC):
+                    encoding = "binary"
+                else:
+                    encoding = "identity"
+                message_queue.offer((datagram, unix_time, encoding)) # Counted as rejected if the queue is full
+        except Exception as e:
+            logging.error(f"Exception in udp_listener_thread: {str(e)}")
+            wait_secs = 1
+            logging.error(f"Restarting udp_listener_thread in {wait_secs} {'sec' if wait_secs == 1 else 'secs'}")
+            time.sleep(wait_secs)
+
 ########################
 # http_listener thread #
 ########################
 
-def http_listener_thread_entrypoint(message_queue: Queue):
+class KeepAliveRequestHandler(WSGIRequestHandler):
+    # Keep connections open between requests, werkzeug closes them after every response when speaking HTTP/1.0
+    # Devices rely on this, for https it saves a tls handshake per request
+    protocol_version = "HTTP/1.1"
+
+    def finish(self):
+        super().finish()
+        # Shut tls down properly, openssl drops the session of a connection that is just closed
+        # (session tickets would still resume, session ids, the only kind esp8266 devices support, wouldn't)
+        if isinstance(self.connection, ssl.SSLSocket):
+            try:
+                self.connection.settimeout(1)
+                self.connection.unwrap()
+            except (OSError, ValueError):
+                pass
+
+def http_listener_thread_entrypoint(message_queue: MessageQueue, port: int, ssl_context=None):
     app = Flask(__name__)
 
     # Disable logging each request
     logging.getLogger('werkzeug').setLevel(logging.ERROR)
 
+    # Queues a message, the response tells the device to slow down while the queue is backed up (WifiHttpClient widens its batching window)
+    def queue_message(payload: bytes, unix_time: int, encoding: str):
+        if not message_queue.offer((payload, unix_time, encoding)):
+            return Response(status=HTTPStatus.TOO_MANY_REQUESTS, headers={"Retry-After": str(BACKPRESSURE_RETRY_AFTER_SECS)})
+        retry_after_secs = message_queue.get_retry_after_secs()
+        if retry_after_secs > 0:
+            return Response(status=HTTPStatus.NO_CONTENT, headers={"Retry-After": str(retry_after_secs)})
+        return Response(status=HTTPStatus.NO_CONTENT)
+
     @app.route("/", methods=['POST'])
     def new_message():
         unix_time = int(time.time() * 1_000_000_000) # utc nanosecond unix timestamp
-        message_queue.put((request.data, unix_time))
-        return Response(status=HTTPStatus.NO_CONTENT)
+        encoding = request.headers.get("Content-Encoding", "identity").lower()
+        if encoding not in ["identity", "gzip"]:
+            return Response(status=HTTPStatus.UNSUPPORTED_MEDIA_TYPE)
+        return queue_message(request.data, unix_time, encoding)
 
-    app.run(host='0.0.0.0', port='8080')
+    @app.route("/binary", methods=['POST'])
+    def new_binary_message():
+        unix_time = int(time.time() * 1_000_000_000) # utc nanosecond unix timestamp
+        return queue_message(request.data, unix_time, "binary")
+
+    app.run(host='0.0.0.0', port=port, ssl_context=ssl_context, request_handler=KeepAliveRequestHandler)
 
 #########
 # setup #
@@ -172,7 +748,7 @@ def http_listener_thread_entrypoint(message_queue: Queue):
 # Set to WARNING to disable printing each message
 logging.root.setLevel(logging.INFO)
 
-message_queue = Queue()
+message_queue = MessageQueue()
 
 message_queue_processor_thread = Thread(
     name="message_queue_processor_thread",
@@ -190,5 +766,26 @@ mqtt_subscriber_thread = Thread(
 )
 mqtt_subscriber_thread.start()
 
+udp_listener_thread = Thread(
+    name="udp_listener_thread",
+    target=udp_listener_thread_entrypoint,
+    args=(message_queue,),
+    daemon=True
+)
+udp_listener_thread.start()
+
+# Optional https listener, for devices that reach the collector across the internet
+# The tls stack of python caches sessions (ids and tickets), so devices can resume them when reconnecting
+HTTPS_CERT_FILE = os.environ.get("HTTPS_CERT_FILE")
+HTTPS_KEY_FILE = os.environ.get("HTTPS_KEY_FILE")
+if HTTPS_CERT_FILE and HTTPS_KEY_FILE:
+    https_listener_thread = Thread(
+        name="https_listener_thread",
+        target=http_listener_thread_entrypoint,
+        args=(message_queue, 8443, (HTTPS_CERT_FILE, HTTPS_KEY_FILE)),
+        daemon=True
+    )
+    https_listener_thread.start()
+
 # Reuse main thread for http listener
-http_listener_thread_entrypoint(message_queue)
+http_listener_thread_entrypoint(message_queue, 8080)
@@ -0,0 +1,89 @@
+# Stand-in for influxdb, to run the collector on any linux machine (e.g. replaying traced data points with trace_replay.py)
+# Accepts writes (line protocol) like influxdb 2.x does, and prints how many lines every bucket received
+#
+# Usage: python3 influxdb_standin.py [--port 8086] [--write-delay-msecs 0] [--print-lines]
+# Then run the collector against it:
+#   INFLUXDB_URL=http://localhost:8086 INFLUXDB_TOKEN=x INFLUXDB_ORG=x MQTT_BROKER_ADDRESS=localhost MQTT_BROKER_PORT=1883 python3 external_collector.py
+# --write-delay-msecs makes every write slow, like influxdb on a busy pi
+
+import argparse, gzip, threading, time
+
+from http import HTTPStatus
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import urlparse, parse_qs
+
+line_counts = {} # Per bucket
+write_count = 0
+line_counts_lock = threading.Lock()
+
+class StandinRequestHandler(BaseHTTPRequestHandler):
+    # Keep connections open between requests, like influxdb
+    protocol_version = "HTTP/1.1"
+    write_delay_secs = 0
+    print_lines = False
+
+    def do_POST(self):
+        global write_count
+        url = urlparse(self.path)
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        if url.path != "/api/v2/write":
+            self.send_empty_response(HTTPStatus.NOT_FOUND)
+            return
+        if self.headers.get("Content-Encoding") == "gzip":
+            body = gzip.decompress(body)
+
+        bucket = parse_qs(url.query).get("bucket", [""])[0]
+        lines = [line for line in body.decode(errors="replace").split("\n") if line.strip() != ""]
+        time.sleep(self.write_delay_secs)
+        with line_counts_lock:
+            line_counts[bucket] = line_counts.get(bucket, 0) + len(lines)
+            write_count += 1
+        if self.print_lines:
+            for line in lines:
+                print(f"{bucket}: {line}", flush=True)
+        self.send_empty_response(HTTPStatus.NO_CONTENT)
+
+    def do_GET(self):
+        # Health checks of the client library
+        if urlparse(self.path).path in ["/ping", "/health"]:
+            self.send_empty_response(HTTPStatus.NO_CONTENT)
+        else:
+            self.send_empty_response(HTTPStatus.NOT_FOUND)
+
+    def send_empty_response(self, status: HTTPStatus):
+        self.send_response(status)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, format, *args):
+        pass # Writes are summarized by print_summaries
+
+def print_summaries(interval_secs: int):
+    previous_total = 0
+    while True:
+        time.sleep(interval_secs)
+        with line_counts_lock:
+            total = sum(line_counts.values())
+            summary = ", ".join(f"{bucket}: {count}" for bucket, count in sorted(line_counts.items()))
+            writes = write_count
+        print(f"{total} lines in {writes} writes ({(total - previous_total) / interval_secs:.1f} lines/sec) {summary}", flush=True)
+        previous_total = total
+
+def main():
+    parser = argparse.ArgumentParser(description="Influxdb stand-in for the home-monitoring collector")
+    parser.add_argument("--port", type=int, default=8086)
+    parser.add_argument("--write-delay-msecs", type=int, default=0)
+    parser.add_argument("--print-lines", action="store_true")
+    parser.add_argument("--summary-interval-secs", type=int, default=10)
+    args = parser.parse_args()
+
+    StandinRequestHandler.write_delay_secs = args.write_delay_msecs / 1000
+    StandinRequestHandler.print_lines = args.print_lines
+    threading.Thread(target=print_summaries, args=(args.summary_interval_secs,), daemon=True).start()
+
+    server = ThreadingHTTPServer(("0.0.0.0", args.port), StandinRequestHandler)
+    print(f"Listening for influxdb writes on port {args.port}", flush=True)
+    server.serve_forever()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+# Stand-in for the collector's https listener, to try out WifiHttpsClient (or any tls client) without influxdb
+# Prints every message, and for every connection whether its tls session was resumed
+#
+# Usage: python3 tls_standin_collector.py [--port 8443] [--cert collector.crt --key collector.key]
+# Without --cert and --key, a self-signed certificate is generated with openssl
+# Check resumption with: openssl s_client -connect localhost:8443 -tls1_2 -reconnect
+
+import argparse, gzip, os, ssl, subprocess, tempfile, threading
+
+from http import HTTPStatus
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+handshake_counts = {"full": 0, "resumed": 0}
+handshake_counts_lock = threading.Lock()
+
+class StandinRequestHandler(BaseHTTPRequestHandler):
+    # Keep connections open between requests, like the collector
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        kind = "resumed" if self.connection.session_reused else "full"
+        with handshake_counts_lock:
+            handshake_counts[kind] += 1
+            print(f"{self.client_address[0]}:{self.client_address[1]} connected, {kind} handshake ({handshake_counts['full']} full, {handshake_counts['resumed']} resumed so far)", flush=True)
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        if self.headers.get("Content-Encoding") == "gzip":
+            body = gzip.decompress(body)
+        print(f"{self.client_address[0]}:{self.client_address[1]} {self.path}: {body.decode(errors='replace')}", flush=True)
+        self.send_response(HTTPStatus.NO_CONTENT)
+        self.end_headers()
+
+    def log_message(self, format, *args):
+        pass # Requests are already printed by do_POST
+
+    def finish(self):
+        super().finish()
+        # Shut tls down properly, openssl drops the session of a connection that is just closed
+        # (session tickets would still resume, session ids wouldn't), same as the collector does
+        try:
+            self.connection.settimeout(1)
+            self.connection.unwrap()
+        except (OSError, ValueError):
+            pass
+
+def generate_self_signed_cert(directory: str):
+    cert_file = os.path.join(directory, "collector.crt")
+    key_file = os.path.join(directory, "collector.key")
+    subprocess.run(
+        ["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1", "-subj", "/CN=localhost",
+         "-keyout", key_file, "-out", cert_file],
+        check=True, capture_output=True
+    )
+    return cert_file, key_file
+
+def main():
+    parser = argparse.ArgumentParser(description="Tls stand-in for the home-monitoring collector")
+    parser.add_argument("--port", type=int, default=8443)
+    parser.add_argument("--cert")
+    parser.add_argument("--key")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        cert_file, key_file = (args.cert, args.key) if args.cert and args.key else generate_self_signed_cert(directory)
+
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(cert_file, key_file)
+
+        server = ThreadingHTTPServer(("0.0.0.0", args.port), StandinRequestHandler)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+        print(f"Listening for https on port {args.port} (certificate: {cert_file})", flush=True)
+        server.serve_forever()
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,55 @@
+# Sends traced data points to the collector over http, like a device sending a telegram every second would
+# Used with influxdb_standin.py to watch the collector's latency report (its log, or "collector_latency" in the heartbeat bucket)
+#
+# Usage: python3 trace_replay.py [--url http://localhost:8080/] [--rate 1] [--batch-size 1] [--duration-secs 60] [--drop-every 0]
+# --batch-size holds back data points to send them together, like PointBatch (their device latency grows accordingly)
+# --drop-every N skips every Nth data point, the collector should report them as missing
+
+import argparse, json, time, urllib.request
+
+def make_data_point(source: str, sequence: int):
+    capture_time = time.time_ns()
+    return {
+        "bucket": "default",
+        "measurement": "trace_replay",
+        "time": str(capture_time),
+        "trace": {"source": source, "sequence": sequence, "capture_time": str(capture_time)},
+        "fields": {"power_delivered": round(0.4 + (sequence * 7919 % 1300) / 1000, 3)},
+    }
+
+def send(url: str, data_points: list):
+    request = urllib.request.Request(url, data=json.dumps(data_points).encode(), method="POST")
+    with urllib.request.urlopen(request) as response:
+        response.read()
+
+def main():
+    parser = argparse.ArgumentParser(description="Sends traced data points to the home-monitoring collector")
+    parser.add_argument("--url", default="http://localhost:8080/")
+    parser.add_argument("--source", default="trace-replay")
+    parser.add_argument("--rate", type=float, default=1, help="Data points per second")
+    parser.add_argument("--batch-size", type=int, default=1)
+    parser.add_argument("--duration-secs", type=float, default=60)
+    parser.add_argument("--drop-every", type=int, default=0)
+    args = parser.parse_args()
+
+    start_time = time.monotonic()
+    batch = []
+    sequence = 0
+    dropped_count = 0
+    while time.monotonic() - start_time < args.duration_secs:
+        sequence += 1
+        if args.drop_every > 0 and sequence % args.drop_every == 0:
+            dropped_count += 1
+        else:
+            batch.append(make_data_point(args.source, sequence))
+        if len(batch) >= args.batch_size:
+            send(args.url, batch)
+            batch = []
+        time.sleep(max(0, start_time + sequence / args.rate - time.monotonic()))
+    if len(batch) > 0:
+        send(args.url, batch)
+
+    print(f"Sent {sequence - dropped_count} data points, dropped {dropped_count} on purpose")
+
+if __name__ == "__main__":
+    main()